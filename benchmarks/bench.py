@@ -0,0 +1,322 @@
+# -*- coding: utf-8 -*-
+
+
+"""
+mood.sqlite micro benchmarks (against the standard library sqlite3 module)
+
+    python benchmarks/bench.py [--rows N] [--ops N] [--threads N] [--db ...]
+                               [--only case ...]
+
+every case runs on a :memory: database and on a temporary file (multi-threaded
+readers only on the file), it reports operations per second, p50/p99 latency
+per operation and memory blocks allocated (and kept alive by the result) per
+row.
+"""
+
+
+from argparse import ArgumentParser
+from os import remove, rmdir
+from os.path import join
+from random import Random
+from sys import getallocatedblocks
+from tempfile import mkdtemp
+from threading import Barrier, Thread
+from time import perf_counter_ns
+
+import sqlite3
+
+from mood import sqlite
+
+
+FLAGS = sqlite.SQLITE_OPEN_READWRITE | sqlite.SQLITE_OPEN_CREATE
+
+SCHEMA = (
+    "CREATE TABLE narrow (id INTEGER PRIMARY KEY, name TEXT, value REAL)",
+    (
+        "CREATE TABLE wide (id INTEGER PRIMARY KEY, {})".format(
+            ", ".join("c{} INTEGER".format(i) for i in range(16))
+        )
+    ),
+    "CREATE TABLE mixed (id INTEGER PRIMARY KEY, t TEXT, b BLOB, i INTEGER)",
+    "CREATE TABLE bulk (id INTEGER, t TEXT, i INTEGER)",
+)
+
+
+# ------------------------------------------------------------------------------
+# data
+
+def narrow_rows(count):
+    return [(i, "name-{}".format(i), i * 0.5) for i in range(count)]
+
+
+def wide_rows(count):
+    return [(i, *range(i, i + 16)) for i in range(count)]
+
+
+def mixed_rows(count):
+    random = Random(count)
+    return [
+        (i, "text-{}".format(i) * random.randint(1, 8), random.randbytes(64), i)
+        for i in range(count)
+    ]
+
+
+def bulk_rows(count):
+    return [(i, "bulk-{}".format(i), i) for i in range(count)]
+
+
+# ------------------------------------------------------------------------------
+# backends
+
+class Mood(object):
+
+    name = "mood"
+
+    def __init__(self, path):
+        self.path = path
+        self.db = self.connect()
+
+    def connect(self):
+        return sqlite.Database(self.path, FLAGS)
+
+    def load(self, rows):
+        for sql in SCHEMA:
+            self.db.execute(sql)
+        for table, data in rows.items():
+            self.db.execute(
+                "INSERT INTO {} VALUES ({})".format(
+                    table, ", ".join("?" * len(data[0]))
+                ),
+                data,
+                transaction=True
+            )
+
+    def lookup(self, db, key):
+        return db.execute("SELECT * FROM narrow WHERE id = ?", [(key,)])
+
+    def scan(self, table):
+        return self.db.execute("SELECT * FROM {}".format(table))
+
+    def insert(self, rows):
+        self.db.execute("INSERT INTO bulk VALUES (?, ?, ?)", rows, transaction=True)
+
+    def close(self):
+        del self.db
+
+
+class MoodTuple(Mood):
+
+    name = "mood/tuple"
+
+    def connect(self):
+        return sqlite.Database(
+            self.path, FLAGS, row_format=sqlite.ROW_TUPLE
+        )
+
+
+class Stdlib(object):
+
+    name = "sqlite3"
+
+    def __init__(self, path):
+        self.path = path
+        self.db = self.connect()
+
+    def connect(self):
+        return sqlite3.connect(
+            self.path, isolation_level=None, check_same_thread=False
+        )
+
+    def load(self, rows):
+        for sql in SCHEMA:
+            self.db.execute(sql)
+        for table, data in rows.items():
+            self.db.execute("BEGIN")
+            self.db.executemany(
+                "INSERT INTO {} VALUES ({})".format(
+                    table, ", ".join("?" * len(data[0]))
+                ),
+                data
+            )
+            self.db.execute("COMMIT")
+
+    def lookup(self, db, key):
+        return db.execute("SELECT * FROM narrow WHERE id = ?", (key,)).fetchall()
+
+    def scan(self, table):
+        return self.db.execute("SELECT * FROM {}".format(table)).fetchall()
+
+    def insert(self, rows):
+        self.db.execute("BEGIN")
+        self.db.executemany("INSERT INTO bulk VALUES (?, ?, ?)", rows)
+        self.db.execute("COMMIT")
+
+    def close(self):
+        self.db.close()
+        del self.db
+
+
+BACKENDS = (Stdlib, Mood, MoodTuple)
+
+
+# ------------------------------------------------------------------------------
+# measures
+
+def percentile(timings, p):
+    return timings[min(len(timings) - 1, int(len(timings) * p))]
+
+
+def blocks_per_row(func, rows):
+    # blocks kept alive by one result
+    func()
+    before = getallocatedblocks()
+    result = func()
+    after = getallocatedblocks()
+    del result
+    return (after - before) / max(rows, 1)
+
+
+def measure(func, ops):
+    timings = []
+    for _ in range(ops):
+        start = perf_counter_ns()
+        func()
+        timings.append(perf_counter_ns() - start)
+    timings.sort()
+    return (
+        ops / (sum(timings) / 1e9),
+        percentile(timings, 0.50) / 1e3,
+        percentile(timings, 0.99) / 1e3
+    )
+
+
+def report(case, backend, kind, result, blocks=None):
+    ops, p50, p99 = result
+    print(
+        "{:<18} {:<11} {:<7} {:>14,.0f} ops/s  p50 {:>10,.1f}us  "
+        "p99 {:>10,.1f}us  {}".format(
+            case, backend, kind, ops, p50, p99,
+            "" if blocks is None else "{:6.2f} blocks/row".format(blocks)
+        )
+    )
+
+
+# ------------------------------------------------------------------------------
+# cases
+
+def point_lookup(backend, args):
+    random = Random(0)
+    keys = [random.randrange(args.rows) for _ in range(args.ops)]
+    keys = iter(keys * 2)
+    func = lambda: backend.lookup(backend.db, next(keys))
+    return measure(func, args.ops), blocks_per_row(func, 1)
+
+
+def wide_scan(backend, args):
+    func = lambda: backend.scan("wide")
+    return measure(func, max(args.ops // 1000, 5)), blocks_per_row(func, args.rows)
+
+
+def mixed_scan(backend, args):
+    func = lambda: backend.scan("mixed")
+    return measure(func, max(args.ops // 1000, 5)), blocks_per_row(func, args.rows)
+
+
+def bulk_insert(backend, args):
+    rows = bulk_rows(args.rows)
+    func = lambda: backend.insert(rows)
+    return measure(func, max(args.ops // 5000, 3)), None
+
+
+def threaded_readers(backend, args):
+    # one connection per thread, every thread does ops lookups
+    barrier = Barrier(args.threads + 1)
+    timings = []
+
+    def reader(seed):
+        db = backend.connect()
+        random = Random(seed)
+        keys = [random.randrange(args.rows) for _ in range(args.ops)]
+        local = []
+        barrier.wait()
+        for key in keys:
+            start = perf_counter_ns()
+            backend.lookup(db, key)
+            local.append(perf_counter_ns() - start)
+        timings.extend(local)
+
+    threads = [Thread(target=reader, args=(i,)) for i in range(args.threads)]
+    for thread in threads:
+        thread.start()
+    barrier.wait()
+    start = perf_counter_ns()
+    for thread in threads:
+        thread.join()
+    elapsed = perf_counter_ns() - start
+    timings.sort()
+    return (
+        (
+            len(timings) / (elapsed / 1e9),
+            percentile(timings, 0.50) / 1e3,
+            percentile(timings, 0.99) / 1e3
+        ),
+        None
+    )
+
+
+CASES = {
+    "point_lookup": (point_lookup, False),
+    "wide_scan": (wide_scan, False),
+    "mixed_scan": (mixed_scan, False),
+    "bulk_insert": (bulk_insert, False),
+    "threaded_readers": (threaded_readers, True),
+}
+
+
+# ------------------------------------------------------------------------------
+# main
+
+def run(args):
+    rows = {
+        "narrow": narrow_rows(args.rows),
+        "wide": wide_rows(args.rows),
+        "mixed": mixed_rows(args.rows),
+    }
+    tmp = mkdtemp(prefix="mood-bench-")
+    for kind in args.db:
+        for name in args.only:
+            case, needs_file = CASES[name]
+            if needs_file and (kind == "memory"):
+                continue
+            for factory in BACKENDS:
+                path = (
+                    ":memory:" if kind == "memory"
+                    else join(tmp, "{}.db".format(factory.name.replace("/", "-")))
+                )
+                backend = factory(path)
+                try:
+                    backend.load(rows)
+                    report(name, factory.name, kind, *case(backend, args))
+                finally:
+                    backend.close()
+                    if kind == "file":
+                        remove(path)
+    rmdir(tmp)
+
+
+def main():
+    parser = ArgumentParser(description="mood.sqlite micro benchmarks")
+    parser.add_argument("--rows", type=int, default=100000)
+    parser.add_argument("--ops", type=int, default=100000)
+    parser.add_argument("--threads", type=int, default=4)
+    parser.add_argument(
+        "--db", nargs="+", choices=("memory", "file"), default=("memory", "file")
+    )
+    parser.add_argument(
+        "--only", nargs="+", choices=tuple(CASES), default=tuple(CASES)
+    )
+    run(parser.parse_args())
+
+
+if __name__ == "__main__":
+    main()
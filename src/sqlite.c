@@ -1,16 +1,242 @@
 #define PY_SSIZE_T_CLEAN
 #include "Python.h"
 #include "structmember.h"
+#include "pythread.h"
 
 #include "helpers/helpers.h"
 
 
+#include <stdatomic.h>
+#include <sys/stat.h>
+
 #include <sqlite3.h>
 
 
 /* -------------------------------------------------------------------------- */
 
 static PyObject *SQLiteError = NULL;
+static PyObject *ProgrammingError = NULL;
+static PyObject *GetRunningLoop = NULL;
+static PyTypeObject Database_Type;
+static PyTypeObject Buffer_Type;
+static PyTypeObject Column_Type;
+static PyTypeObject Cursor_Type;
+static PyTypeObject Statement_Type;
+static PyTypeObject Transaction_Type;
+static PyTypeObject Blob_Type;
+
+
+/* Value */
+typedef struct {
+    int type;
+    Py_ssize_t size;
+    union {
+        long long l;
+        double d;
+        const char *s;
+        size_t offset;
+    } value;
+} Value;
+
+
+/* Chunk */
+typedef struct {
+    Value *values;
+    char *data;
+    size_t size;
+    size_t used;
+    Py_ssize_t capacity;
+    Py_ssize_t rows;
+    int cols;
+} Chunk;
+
+
+/* Decoder */
+#define __INTERN_SLOTS__ 256
+#define __INTERN_SIZE__ 64
+#define __INTERN_PROBE__ 4096
+
+typedef struct {
+    PyObject *objs[__INTERN_SLOTS__];
+    unsigned long long keys[__INTERN_SLOTS__];
+    unsigned long long lookups;
+    unsigned long long hits;
+} Interned;
+
+
+typedef struct {
+    int type;
+    Interned *interned;
+} Decoder;
+
+
+typedef struct {
+    int len;
+    int intern;
+    Decoder decoders[];
+} Plan;
+
+
+/* Stmt */
+typedef struct _Stmt {
+    struct _Stmt *prev;
+    struct _Stmt *next;
+    PyObject *key;
+    PyObject *capsule;
+    sqlite3_stmt *stmt;
+    PyTypeObject *rowtype;
+    PyObject *columns;
+    PyObject *names;
+    Plan *plan;
+    int reprepared;
+} Stmt;
+
+
+/* StmtCache */
+typedef struct {
+    PyObject *map;
+    Stmt *head;
+    Stmt *tail;
+    Py_ssize_t size;
+    Py_ssize_t capacity;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+} StmtCache;
+
+
+#define __STMT_CACHE_CAPACITY__ 128
+#define __BATCH_SIZE__ 1024
+#define __MMAP_SIZE__ 268435456LL
+#define __FETCH_SIZE__ 256
+#define __PARKED_CAPACITY__ 64
+#define __BACKUP_BACKOFF__ 5 // ms, minimum wait on a locked source
+
+
+enum {
+    __TX_BEGIN__ = 0,
+    __TX_BEGIN_IMMEDIATE__,
+    __TX_BEGIN_EXCLUSIVE__,
+    __TX_COMMIT__,
+    __TX_ROLLBACK__,
+    __TX_LAST__
+};
+
+
+enum {
+    __ROW_STRUCT__ = 0,
+    __ROW_TUPLE__,
+    __ROW_DICT__,
+    __ROW_SCALAR__,
+    __ROW_VALUE__,
+    __ROW_LAST__
+};
+
+
+enum {
+    __FUNCTION_SCALAR__ = 0,
+    __FUNCTION_AGGREGATE__,
+    __FUNCTION_WINDOW__
+};
+
+
+/* Request */
+typedef struct _Request {
+    struct _Request *next;
+    PyObject *db;
+    PyObject *params;
+    PyObject *future;
+    Stmt *entry;
+    Chunk chunk;
+    int format;
+    int rc;
+    int errcode;
+    char *errmsg;
+} Request;
+
+
+/* Worker */
+typedef struct {
+    _Atomic(Request *) pending;
+    _Atomic(Request *) done;
+    atomic_int signaled;
+    atomic_int scheduled;
+    atomic_int stop;
+    PyThread_type_lock wakeup;
+    PyThread_type_lock exited;
+    PyObject *loop;
+} Worker;
+
+
+/* Parked (a warmed up read-only connection, see the registry) */
+typedef struct _Parked {
+    struct _Parked *next;
+    char *key;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+    unsigned int cookie;
+    int tainted;
+    sqlite3 *db;
+    sqlite3_stmt *tx[__TX_LAST__];
+    StmtCache cache;
+} Parked;
+
+
+/* Options (applied at open) */
+typedef struct {
+    const char *journal_mode;
+    const char *synchronous;
+    const char *temp_store;
+    long long mmap_size;
+    PyObject *cache_size;
+    double busy_timeout;
+    int lookaside_size;
+    int lookaside_count;
+} Options;
+
+
+/* Profile */
+typedef struct {
+    char *sql;
+    size_t hash;
+    unsigned long long calls;
+    unsigned long long rows;
+    unsigned long long steps;
+    unsigned long long fullscans;
+    unsigned long long sorts;
+    unsigned long long autoindexes;
+    unsigned long long total;
+    unsigned long long max;
+} ProfileEntry;
+
+
+typedef struct _SlowQuery {
+    struct _SlowQuery *next;
+    char *sql;
+    unsigned long long elapsed;
+    unsigned long long rows;
+} SlowQuery;
+
+
+#define __PROFILE_INFLIGHT__ 64
+
+typedef struct {
+    ProfileEntry *entries;
+    size_t capacity;
+    size_t size;
+    struct {
+        const sqlite3_stmt *stmt;
+        unsigned long long rows;
+        _PyTime_t start;
+    } inflight[__PROFILE_INFLIGHT__];
+    unsigned long long threshold;
+    PyObject *callback;
+    SlowQuery *slow;
+    SlowQuery **tail;
+    PyThread_type_lock lock;
+} Profile;
 
 
 /* Database */
@@ -18,9 +244,178 @@ typedef struct {
     PyObject_HEAD
     PyObject *filename;
     sqlite3 *db;
+    StmtCache cache;
+    sqlite3_stmt *tx[__TX_LAST__];
+    int depth;
+    int group_mode;
+    Py_ssize_t group_size;
+    Py_ssize_t group_count;
+    _PyTime_t group_interval;
+    _PyTime_t group_start;
+    Worker *worker;
+    Profile *profile;
+    PyObject *tables;
+    PyObject *natives;
+    Parked *share;
+    int format;
+    int intern;
+    unsigned long thread;
 } Database;
 
 
+/* Transaction */
+typedef struct {
+    PyObject_HEAD
+    Database *db;
+    int mode;
+    int depth;
+    int savepoint;
+    Py_ssize_t size;
+    _PyTime_t interval;
+} Transaction;
+
+
+/* Buffer */
+typedef struct {
+    PyObject_HEAD
+    void *data;
+    Py_ssize_t len;
+    Py_ssize_t itemsize;
+    const char *format;
+} Buffer;
+
+
+/* Column */
+typedef struct {
+    PyObject_HEAD
+    PyObject *name;
+    int type;
+    Py_ssize_t length;
+    Buffer *data;
+    Buffer *offsets;
+    Buffer *nulls;
+} Column;
+
+
+/* ColumnBuilder */
+typedef struct {
+    int type;
+    char *data;
+    size_t size;
+    size_t capacity;
+    long long *offsets;
+    unsigned char *nulls;
+} ColumnBuilder;
+
+
+/* ColumnSource */
+typedef struct {
+    int type;
+    char format;
+    Py_ssize_t length;
+    Py_buffer data;
+    Py_buffer offsets;
+    Py_buffer nulls;
+} ColumnSource;
+
+
+/* Pool */
+typedef struct {
+    PyObject_HEAD
+    PyObject *filename;
+    Database *writer;
+    PyObject *readers;
+    PyObject *routes;
+    Database **idle;
+    Py_ssize_t size;
+    Py_ssize_t available;
+    PyThread_type_lock lock;
+    int waiters;
+    int signaled;
+    unsigned long long checkouts;
+    unsigned long long waits;
+    _PyTime_t wait_time;
+    _PyTime_t max_wait;
+    Py_ssize_t max_in_use;
+} Pool;
+
+
+/* Partition (of Pool.execute_range()) */
+typedef struct {
+    long long start;
+    long long stop;
+    Chunk chunk;
+    int rc;
+    int errcode;
+    char *errmsg;
+} Partition;
+
+
+/* Range (shared by the runners of Pool.execute_range()) */
+typedef struct {
+    Partition *partitions;
+    Py_ssize_t count;
+    _Atomic(Py_ssize_t) next;
+    atomic_int failed;
+    Value *values;
+    int size;
+} Range;
+
+
+/* Runner */
+typedef struct {
+    Range *range;
+    Database *reader;
+    Stmt *entry;
+    PyThread_type_lock exited;
+} Runner;
+
+
+/* Script (of Database.executescript()) */
+typedef struct {
+    PyObject *params;
+    char *bound;
+    Py_ssize_t count;
+    Py_ssize_t *indexes;
+    Py_ssize_t size;
+    PyObject *results;
+} Script;
+
+
+/* Statement */
+typedef struct {
+    PyObject_HEAD
+    Database *db;
+    Stmt *entry;
+    int busy;
+} Statement;
+
+
+/* Cursor */
+typedef struct {
+    PyObject_HEAD
+    Database *db;
+    Statement *owner;
+    PyObject *params;
+    Stmt *entry;
+    PyObject *layout;
+    int format;
+    int len;
+    Chunk chunk;
+} Cursor;
+
+
+/* Blob */
+typedef struct {
+    PyObject_HEAD
+    Database *db;
+    sqlite3_blob *blob;
+    int size;
+    int offset;
+    int failed;
+} Blob;
+
+
 /* -------------------------------------------------------------------------- */
 
 #define __sqlite_db_errcode__(...) \
@@ -36,6 +431,10 @@ typedef struct {
     __sys_gil_wrap__(int, sqlite3_close_v2, __VA_ARGS__)
 #define __sqlite_db_readonly__(...) \
     __sys_wrap__(long, sqlite3_db_readonly, __VA_ARGS__)
+#define __sqlite_db_autocommit__(...) \
+    __sys_wrap__(int, sqlite3_get_autocommit, __VA_ARGS__)
+#define __sqlite_db_exec__(...) \
+    __sys_gil_wrap__(int, sqlite3_exec, __VA_ARGS__)
 
 
 #define __sqlite_stmt_prepare__(...) \
@@ -44,6 +443,12 @@ typedef struct {
     __sys_gil_wrap__(int, sqlite3_step, __VA_ARGS__)
 #define __sqlite_stmt_finalize__(...) \
     __sys_gil_wrap__(int, sqlite3_finalize, __VA_ARGS__)
+#define __sqlite_stmt_reset__(...) \
+    __sys_wrap__(int, sqlite3_reset, __VA_ARGS__)
+#define __sqlite_stmt_clear__(...) \
+    __sys_wrap__(int, sqlite3_clear_bindings, __VA_ARGS__)
+#define __sqlite_stmt_status__(...) \
+    __sys_wrap__(int, sqlite3_stmt_status, __VA_ARGS__)
 
 
 #define __sqlite_column_long__(...) \
@@ -80,11 +485,39 @@ typedef struct {
 
 #define __sqlite_bind_count__(...) \
     __sys_wrap__(int, sqlite3_bind_parameter_count, __VA_ARGS__)
+#define __sqlite_bind_name__(...) \
+    __sys_wrap__(const char *, sqlite3_bind_parameter_name, __VA_ARGS__)
 
 #define __sqlite_bind_true__(...) __sqlite_bind_bool__(__VA_ARGS__, 1)
 #define __sqlite_bind_false__(...) __sqlite_bind_bool__(__VA_ARGS__, 0)
 
 
+#define __sqlite_blob_open__(...) \
+    __sys_gil_wrap__(int, sqlite3_blob_open, __VA_ARGS__)
+#define __sqlite_blob_close__(...) \
+    __sys_gil_wrap__(int, sqlite3_blob_close, __VA_ARGS__)
+#define __sqlite_blob_reopen__(...) \
+    __sys_gil_wrap__(int, sqlite3_blob_reopen, __VA_ARGS__)
+#define __sqlite_blob_read__(...) \
+    __sys_gil_wrap__(int, sqlite3_blob_read, __VA_ARGS__)
+#define __sqlite_blob_write__(...) \
+    __sys_gil_wrap__(int, sqlite3_blob_write, __VA_ARGS__)
+#define __sqlite_blob_bytes__(...) \
+    __sys_wrap__(int, sqlite3_blob_bytes, __VA_ARGS__)
+
+
+#define __sqlite_backup_init__(...) \
+    __sys_wrap__(sqlite3_backup *, sqlite3_backup_init, __VA_ARGS__)
+#define __sqlite_backup_step__(...) \
+    __sys_gil_wrap__(int, sqlite3_backup_step, __VA_ARGS__)
+#define __sqlite_backup_finish__(...) \
+    __sys_gil_wrap__(int, sqlite3_backup_finish, __VA_ARGS__)
+#define __sqlite_backup_remaining__(...) \
+    __sys_wrap__(int, sqlite3_backup_remaining, __VA_ARGS__)
+#define __sqlite_backup_pagecount__(...) \
+    __sys_wrap__(int, sqlite3_backup_pagecount, __VA_ARGS__)
+
+
 /* -------------------------------------------------------------------------- */
 
 static inline char *
@@ -143,336 +576,8491 @@ static PyTypeObject RowType_Type = {
 
 
 /* --------------------------------------------------------------------------
-    Database
+   Buffer
    -------------------------------------------------------------------------- */
 
-static int
-__db_err_occurred__(Database *self)
+static Buffer *
+__buffer_new__(
+    void *data, Py_ssize_t len, Py_ssize_t itemsize, const char *format
+)
 {
-    switch(__sqlite_db_errcode__(self->db)) {
-        case SQLITE_OK:
-        case SQLITE_ROW:
-        case SQLITE_DONE:
-            return 0;
-        default:
-            return 1;
+    Buffer *self = NULL;
+
+    if ((self = PyObject_New(Buffer, &Buffer_Type))) {
+        self->data = data;
+        self->len = len;
+        self->itemsize = itemsize;
+        self->format = format;
     }
+    else {
+        PyMem_RawFree(data);
+    }
+    return self;
 }
 
 
+/* Buffer_Type.tp_dealloc */
 static void
-_PyErr_FromDatabase(Database *self)
+Buffer_tp_dealloc(Buffer *self)
 {
-    PyObject *_exc_type_ = NULL, *_exc_value_ = NULL, *_exc_traceback_ = NULL;
-    PyObject *_err_occurred_ = NULL, *_filename_ = NULL;
+    PyMem_RawFree(self->data);
+    PyObject_Del(self);
+}
 
-    if ((_err_occurred_ = PyErr_Occurred())) {
-        PyErr_Fetch(&_exc_type_, &_exc_value_, &_exc_traceback_);
+
+/* Buffer_Type.tp_as_sequence.sq_length */
+static Py_ssize_t
+Buffer_sq_length(Buffer *self)
+{
+    return self->len;
+}
+
+
+/* Buffer_Type.tp_as_buffer.bf_getbuffer */
+static int
+Buffer_bf_getbuffer(Buffer *self, Py_buffer *view, int flags)
+{
+    static char empty[1] = { 0 };
+
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "buffer is not writable");
+        view->obj = NULL;
+        return -1;
     }
-    if ((_filename_ = _PyUnicode_DecodeFSDefault(self->filename))) {
-        PyErr_Format(
-            SQLiteError,
-            "[%i] %s: %R",
-            __sqlite_db_extderr__(self->db),
-            __sqlite_db_errmsg__(self->db),
-            _filename_
-        );
-        Py_DECREF(_filename_);
+    view->obj = Py_NewRef(self);
+    view->buf = (self->data) ? self->data : empty;
+    view->len = self->len * self->itemsize;
+    view->readonly = 1;
+    view->ndim = 1;
+    if (flags & PyBUF_FORMAT) {
+        view->itemsize = self->itemsize;
+        view->format = (char *)self->format;
+        view->shape = (flags & PyBUF_ND) ? &self->len : NULL;
+        view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? &self->itemsize : NULL;
     }
-    if (_err_occurred_) {
-        _PyErr_ChainExceptions(_exc_type_, _exc_value_, _exc_traceback_);
+    else {
+        // no format means unsigned bytes
+        view->itemsize = 1;
+        view->format = NULL;
+        view->shape = (flags & PyBUF_ND) ? &view->len : NULL;
+        view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? &view->itemsize : NULL;
     }
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
 }
 
 
-/* -------------------------------------------------------------------------- */
+static PySequenceMethods Buffer_as_sequence = {
+    .sq_length = (lenfunc)Buffer_sq_length,
+};
 
-static Database *
-__db_alloc__(PyTypeObject *type)
-{
-    Database *self = NULL;
 
-    if ((self = PyObject_GC_NEW(Database, type))) {
-        self->filename = NULL;
-        self->db = NULL;
-    }
-    return self;
-}
+static PyBufferProcs Buffer_as_buffer = {
+    .bf_getbuffer = (getbufferproc)Buffer_bf_getbuffer,
+};
 
 
-static int
-__db_open__(Database *self, int flags)
-{
-    int rc = SQLITE_OK;
+/* Buffer_Type -------------------------------------------------------------- */
 
-    rc = __sqlite_db_open__(
-        PyBytes_AS_STRING(self->filename), &self->db, flags, NULL
-    );
-    if (rc) {
-        _PyErr_FromDatabase(self);
-        if (self->db) {
-            if (__sqlite_db_close__(self->db)) {
-                _PyErr_FromDatabase(self);
-            }
-            self->db = NULL;
-        }
-    }
-    return (rc != SQLITE_OK) ? -1 : 0;
+static PyTypeObject Buffer_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.sqlite.Buffer",
+    .tp_basicsize = sizeof(Buffer),
+    .tp_dealloc = (destructor)Buffer_tp_dealloc,
+    .tp_as_sequence = &Buffer_as_sequence,
+    .tp_as_buffer = &Buffer_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+};
+
+
+/* --------------------------------------------------------------------------
+   Column
+   -------------------------------------------------------------------------- */
+
+/* the builder runs without the GIL, numeric columns are stored as int64 or
+   double (an integer column is promoted to double on its first float value),
+   text and blob columns as offsets + data, a NULL sets a bit in nulls */
+
+#define __COLUMN_ROWS__ 1024
+
+
+static void
+__column_builder_free__(ColumnBuilder *col)
+{
+    PyMem_RawFree(col->data);
+    col->data = NULL;
+    PyMem_RawFree(col->offsets);
+    col->offsets = NULL;
+    PyMem_RawFree(col->nulls);
+    col->nulls = NULL;
 }
 
 
 static int
-__db_close__(Database *self)
+__column_builder_grow__(ColumnBuilder *col, Py_ssize_t old, Py_ssize_t new)
 {
-    int rc = SQLITE_OK;
+    void *ptr = NULL;
 
-    if (self->db) {
-        if ((rc = __sqlite_db_close__(self->db))) {
-            _PyErr_FromDatabase(self);
-        }
-        self->db = NULL;
+    if (!(ptr = PyMem_RawRealloc(col->nulls, (new + 7) / 8))) {
+        return SQLITE_NOMEM;
     }
-    return (rc != SQLITE_OK) ? -1 : 0;
+    col->nulls = ptr;
+    memset(col->nulls + ((old + 7) / 8), 0, ((new + 7) / 8) - ((old + 7) / 8));
+    switch (col->type) {
+        case SQLITE_INTEGER:
+        case SQLITE_FLOAT:
+            if (!(ptr = PyMem_RawRealloc(col->data, new * 8))) {
+                return SQLITE_NOMEM;
+            }
+            col->data = ptr;
+            break;
+        case SQLITE_TEXT:
+        case SQLITE_BLOB:
+            if (!(ptr = PyMem_RawRealloc(col->offsets, (new + 1) * 8))) {
+                return SQLITE_NOMEM;
+            }
+            col->offsets = ptr;
+            break;
+        default:
+            break;
+    }
+    return SQLITE_OK;
 }
 
 
-/* -------------------------------------------------------------------------- */
-
-#define __params_size__ PySequence_Fast_GET_SIZE
-#define __params_item__ PySequence_Fast_GET_ITEM
-
-
 static int
-__params_check__(PyObject *params)
+__column_builder_init__(ColumnBuilder *col, int type, Py_ssize_t capacity)
 {
-    if (PyList_CheckExact(params) || PyTuple_CheckExact(params)) {
-        return 1;
+    // all previous rows are NULL
+    col->type = type;
+    switch (type) {
+        case SQLITE_INTEGER:
+        case SQLITE_FLOAT:
+            col->data = PyMem_RawCalloc(capacity, 8);
+            return (col->data) ? SQLITE_OK : SQLITE_NOMEM;
+        default:
+            col->offsets = PyMem_RawCalloc(capacity + 1, 8);
+            return (col->offsets) ? SQLITE_OK : SQLITE_NOMEM;
     }
-    PyErr_Format(
-        PyExc_TypeError,
-        "parameters must be a list or tuple, not %.200s",
-        Py_TYPE(params)->tp_name
-    );
-    return 0;
 }
 
 
 static int
-__params_converter__(PyObject *arg, void *addr)
+__column_builder_bytes__(
+    ColumnBuilder *col, Py_ssize_t row, const void *data, size_t size
+)
 {
-    int res = 0;
+    size_t capacity = col->capacity;
+    char *ptr = NULL;
 
-    if ((res = __params_check__(arg))) {
-        *(PyObject **)addr = arg;
+    if ((col->size + size) > capacity) {
+        while ((col->size + size) > capacity) {
+            capacity = (capacity) ? (capacity * 2) : 65536;
+        }
+        if (!(ptr = PyMem_RawRealloc(col->data, capacity))) {
+            return SQLITE_NOMEM;
+        }
+        col->data = ptr;
+        col->capacity = capacity;
     }
-    return res;
+    if (size) {
+        memcpy(col->data + col->size, data, size);
+    }
+    col->size += size;
+    col->offsets[row + 1] = col->size;
+    return SQLITE_OK;
 }
 
 
-/* -------------------------------------------------------------------------- */
-
-static PyTypeObject *
-__new_rowtype__(Database *self, sqlite3_stmt *stmt, int len)
+static int
+__column_builder_store__(
+    ColumnBuilder *col,
+    sqlite3_stmt *stmt,
+    int i,
+    Py_ssize_t row,
+    Py_ssize_t capacity
+)
 {
-    PyStructSequence_Desc _desc_ = { .name = "mood.sqlite.Row" };
-    PyStructSequence_Field *_fields_ = NULL;
-    PyTypeObject *_type_ = NULL;
-    int i;
+    long long *longs = NULL;
+    double *doubles = NULL;
+    Py_ssize_t r;
+    int type = sqlite3_column_type(stmt, i), rc = SQLITE_OK;
 
-    if (!(_fields_ = PyMem_Calloc((len + 1), sizeof(PyStructSequence_Field)))) {
-        goto fail;
-    }
-    for (i = 0; i < len; ++i) {
-        if (!(_fields_[i].name = __strdup__(__sqlite_column_name__(stmt, i)))) {
-            goto fail;
+    if (type == SQLITE_NULL) {
+        col->nulls[row >> 3] |= (1 << (row & 7));
+        switch (col->type) {
+            case SQLITE_INTEGER:
+            case SQLITE_FLOAT:
+                ((long long *)col->data)[row] = 0;
+                break;
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                col->offsets[row + 1] = col->size;
+                break;
+            default:
+                break;
         }
+        return SQLITE_OK;
     }
-    _desc_.fields = _fields_;
-    _desc_.n_in_sequence = len;
-    if ((_type_ = PyStructSequence_NewType(&_desc_))) {
-        Py_SET_TYPE(_type_, &RowType_Type);
-        PyMem_Free(_fields_);
-        return _type_;
+    if (
+        (col->type == SQLITE_NULL) &&
+        (rc = __column_builder_init__(col, type, capacity))
+    ) {
+        return rc;
     }
-fail:
-    if (_fields_) {
-        for (i = 0; i < len; ++i) {
-            if(_fields_[i].name) {
-                free((void *)_fields_[i].name);
-                _fields_[i].name = NULL;
+    switch (col->type) {
+        case SQLITE_INTEGER:
+            if (type != SQLITE_FLOAT) {
+                ((long long *)col->data)[row] = sqlite3_column_int64(stmt, i);
+                break;
             }
-        }
-        PyMem_Free(_fields_);
-        _fields_ = NULL;
+            longs = (long long *)col->data;
+            doubles = (double *)col->data;
+            for (r = 0; r < row; ++r) {
+                doubles[r] = (double)longs[r];
+            }
+            col->type = SQLITE_FLOAT;
+            /* fallthrough */
+        case SQLITE_FLOAT:
+            ((double *)col->data)[row] = sqlite3_column_double(stmt, i);
+            break;
+        case SQLITE_TEXT:
+            rc = __column_builder_bytes__(
+                col,
+                row,
+                sqlite3_column_text(stmt, i),
+                sqlite3_column_bytes(stmt, i)
+            );
+            break;
+        case SQLITE_BLOB:
+            rc = __column_builder_bytes__(
+                col,
+                row,
+                sqlite3_column_blob(stmt, i),
+                sqlite3_column_bytes(stmt, i)
+            );
+            break;
+        default:
+            break;
     }
-    if (!PyErr_Occurred()) {
-        PyErr_NoMemory();
+    return rc;
+}
+
+
+/* step stmt to completion into count builders */
+static int
+__column_builders_fill__(
+    ColumnBuilder *cols, int count, sqlite3_stmt *stmt, Py_ssize_t *rows
+)
+{
+    Py_ssize_t row = 0, capacity = 0;
+    int rc = SQLITE_OK, i;
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (row == capacity) {
+            for (i = 0; i < count; ++i) {
+                if (
+                    (
+                        rc = __column_builder_grow__(
+                            &cols[i],
+                            capacity,
+                            (capacity) ? (capacity * 2) : __COLUMN_ROWS__
+                        )
+                    )
+                ) {
+                    goto exit;
+                }
+            }
+            capacity = (capacity) ? (capacity * 2) : __COLUMN_ROWS__;
+        }
+        for (i = 0; i < count; ++i) {
+            if ((rc = __column_builder_store__(&cols[i], stmt, i, row, capacity))) {
+                goto exit;
+            }
+        }
+        row++;
     }
-    return NULL;
+exit:
+    *rows = row;
+    return rc;
 }
 
 
 static PyObject *
-__column_value__(Database *self, sqlite3_stmt *stmt, int i)
+__column_new__(ColumnBuilder *col, const char *name, Py_ssize_t rows)
 {
-    PyObject *value = NULL;
+    Column *self = NULL;
 
-    switch (__sqlite_column_type__(stmt, i)) {
+    if (!(self = PyObject_GC_New(Column, &Column_Type))) {
+        return NULL;
+    }
+    self->type = col->type;
+    self->length = rows;
+    self->data = self->offsets = self->nulls = NULL;
+    PyObject_GC_Track(self);
+    if (!(self->name = PyUnicode_FromString(name))) {
+        goto fail;
+    }
+    switch (col->type) {
         case SQLITE_INTEGER:
-            {
-                long long _value_ = __sqlite_column_long__(stmt, i);
-                if (!__db_err_occurred__(self)) {
-                    value = PyLong_FromLongLong(_value_);
-                }
-            }
+            self->data = __buffer_new__(col->data, rows, 8, "q");
             break;
         case SQLITE_FLOAT:
-            {
-                double _value_ = __sqlite_column_float__(stmt, i);
-                if (!__db_err_occurred__(self)) {
-                    value = PyFloat_FromDouble(_value_);
-                }
-            }
+            self->data = __buffer_new__(col->data, rows, 8, "d");
             break;
         case SQLITE_TEXT:
-            {
-                const char *_value_ = __sqlite_column_unicode__(stmt, i);
-                if (_value_) {
-                    value = PyUnicode_FromStringAndSize(
-                        _value_, __sqlite_column_size__(stmt, i)
-                    );
-                }
-            }
-            break;
         case SQLITE_BLOB:
-            {
-                const char *_value_ = __sqlite_column_bytes__(stmt, i);
-                if (_value_) {
-                    value = PyBytes_FromStringAndSize(
-                        _value_, __sqlite_column_size__(stmt, i)
-                    );
-                }
+            self->data = __buffer_new__(col->data, col->size, 1, "B");
+            col->data = NULL;
+            if (!self->data) {
+                goto fail;
+            }
+            self->offsets = __buffer_new__(col->offsets, rows + 1, 8, "q");
+            col->offsets = NULL;
+            if (!self->offsets) {
+                goto fail;
             }
-            break;
-        case SQLITE_NULL:
-            value = Py_NewRef(Py_None);
             break;
         default:
-            PyErr_SetString(PyExc_TypeError, "unknown sqlite3 datatype");
+            self->data = __buffer_new__(NULL, 0, 1, "B");
             break;
     }
-    if ((value == NULL) && !PyErr_Occurred()) {
-        _PyErr_FromDatabase(self);
+    col->data = NULL; // owned (or freed) by self->data
+    if (!self->data) {
+        goto fail;
     }
-    return value;
+    self->nulls = __buffer_new__(col->nulls, (rows + 7) / 8, 1, "B");
+    col->nulls = NULL;
+    if (!self->nulls) {
+        goto fail;
+    }
+    return (PyObject *)self;
+fail:
+    Py_CLEAR(self);
+    return NULL;
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/* Column_Type.tp_traverse */
 static int
-__stmt_row__(
-    Database *self,
-    sqlite3_stmt *stmt,
-    int len,
-    PyObject *rows,
-    PyTypeObject **rowtype
+Column_tp_traverse(Column *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->name);
+    return 0;
+}
+
+
+/* Column_Type.tp_clear */
+static int
+Column_tp_clear(Column *self)
+{
+    Py_CLEAR(self->nulls);
+    Py_CLEAR(self->offsets);
+    Py_CLEAR(self->data);
+    Py_CLEAR(self->name);
+    return 0;
+}
+
+
+/* Column_Type.tp_dealloc */
+static void
+Column_tp_dealloc(Column *self)
+{
+    PyObject_GC_UnTrack(self);
+    Column_tp_clear(self);
+    PyObject_GC_Del(self);
+}
+
+
+/* Column_Type.tp_repr */
+static PyObject *
+Column_tp_repr(Column *self)
+{
+    return PyUnicode_FromFormat(
+        "<%s(%R, type=%d, length=%zd)>",
+        Py_TYPE(self)->tp_name,
+        self->name,
+        self->type,
+        self->length
+    );
+}
+
+
+/* Column_Type.tp_as_sequence.sq_length */
+static Py_ssize_t
+Column_sq_length(Column *self)
+{
+    return self->length;
+}
+
+
+/* Column_Type.tp_as_buffer.bf_getbuffer */
+static int
+Column_bf_getbuffer(Column *self, Py_buffer *view, int flags)
+{
+    return Buffer_bf_getbuffer(self->data, view, flags);
+}
+
+
+static PySequenceMethods Column_as_sequence = {
+    .sq_length = (lenfunc)Column_sq_length,
+};
+
+
+static PyBufferProcs Column_as_buffer = {
+    .bf_getbuffer = (getbufferproc)Column_bf_getbuffer,
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Column.name */
+static PyObject *
+Column_name_getter(Column *self, void *closure)
+{
+    return Py_NewRef(self->name);
+}
+
+
+/* Column.type */
+static PyObject *
+Column_type_getter(Column *self, void *closure)
+{
+    return PyLong_FromLong(self->type);
+}
+
+
+/* Column.data */
+static PyObject *
+Column_data_getter(Column *self, void *closure)
+{
+    return Py_NewRef(self->data);
+}
+
+
+/* Column.offsets */
+static PyObject *
+Column_offsets_getter(Column *self, void *closure)
+{
+    return Py_NewRef((self->offsets) ? (PyObject *)self->offsets : Py_None);
+}
+
+
+/* Column.nulls */
+static PyObject *
+Column_nulls_getter(Column *self, void *closure)
+{
+    return Py_NewRef(self->nulls);
+}
+
+
+/* Column_Type.tp_getsets */
+static PyGetSetDef Column_tp_getset[] = {
+    {"name", (getter)Column_name_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {"type", (getter)Column_type_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {"data", (getter)Column_data_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {"offsets", (getter)Column_offsets_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {"nulls", (getter)Column_nulls_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {NULL}
+};
+
+
+/* Column_Type -------------------------------------------------------------- */
+
+static PyTypeObject Column_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.sqlite.Column",
+    .tp_basicsize = sizeof(Column),
+    .tp_dealloc = (destructor)Column_tp_dealloc,
+    .tp_repr = (reprfunc)Column_tp_repr,
+    .tp_as_sequence = &Column_as_sequence,
+    .tp_as_buffer = &Column_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_traverse = (traverseproc)Column_tp_traverse,
+    .tp_clear = (inquiry)Column_tp_clear,
+    .tp_getset = Column_tp_getset,
+};
+
+
+/* --------------------------------------------------------------------------
+   ColumnSource
+   -------------------------------------------------------------------------- */
+
+/* a column source is the write side of a Column, it can be:
+   - a Column,
+   - an (offsets, data[, type]) tuple for text (the default) or blob,
+   - a 1-dimensional buffer of integers or floats,
+   - None (all NULL) */
+
+static int
+__column_source_format__(ColumnSource *src, Py_buffer *view)
+{
+    const char *format = (view->format) ? view->format : "B";
+
+    if ((format[0] == '@') || (format[0] == '=')) {
+        format++;
+    }
+    if (format[0] && !format[1]) {
+        switch (format[0]) {
+            case '?':
+            case 'b':
+            case 'B':
+            case 'h':
+            case 'H':
+            case 'i':
+            case 'I':
+            case 'l':
+            case 'q':
+            case 'n':
+                src->type = SQLITE_INTEGER;
+                break;
+            case 'L':
+                src->type = (view->itemsize < 8) ? SQLITE_INTEGER : 0;
+                break;
+            case 'f':
+            case 'd':
+                src->type = SQLITE_FLOAT;
+                break;
+            default:
+                src->type = 0;
+                break;
+        }
+        if (src->type) {
+            src->format = format[0];
+            return 0;
+        }
+    }
+    PyErr_Format(PyExc_TypeError, "unsupported buffer format: '%s'", format);
+    return -1;
+}
+
+
+static int
+__column_source_buffer__(PyObject *obj, Py_buffer *view)
+{
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT)) {
+        return -1;
+    }
+    if (view->ndim > 1) {
+        PyErr_SetString(PyExc_TypeError, "buffer must be 1-dimensional");
+        PyBuffer_Release(view);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+__column_source_offsets__(ColumnSource *src)
+{
+    Py_buffer *view = &src->offsets;
+
+    if (
+        __column_source_format__(src, view) ||
+        (src->type != SQLITE_INTEGER) ||
+        ((view->itemsize != 4) && (view->itemsize != 8))
+    ) {
+        PyErr_Clear();
+        PyErr_SetString(
+            PyExc_TypeError, "offsets must be a buffer of int32 or int64"
+        );
+        return -1;
+    }
+    if ((src->length = (view->len / view->itemsize) - 1) < 0) {
+        PyErr_SetString(PyExc_ValueError, "offsets must not be empty");
+        return -1;
+    }
+    return 0;
+}
+
+
+static void
+__column_source_release__(ColumnSource *src)
+{
+    if (src->data.obj) {
+        PyBuffer_Release(&src->data);
+    }
+    if (src->offsets.obj) {
+        PyBuffer_Release(&src->offsets);
+    }
+    if (src->nulls.obj) {
+        PyBuffer_Release(&src->nulls);
+    }
+}
+
+
+static int
+__column_source_init__(ColumnSource *src, PyObject *obj)
+{
+    PyObject *offsets = NULL, *data = NULL;
+    Column *column = NULL;
+    int type = SQLITE_TEXT;
+
+    memset(src, 0, sizeof(ColumnSource));
+    if (obj == Py_None) {
+        src->type = SQLITE_NULL;
+        src->length = -1;
+        return 0;
+    }
+    if (PyObject_TypeCheck(obj, &Column_Type)) {
+        column = (Column *)obj;
+        src->type = column->type;
+        src->length = column->length;
+        if (
+            __column_source_buffer__((PyObject *)column->data, &src->data) ||
+            __column_source_buffer__((PyObject *)column->nulls, &src->nulls) ||
+            (
+                column->offsets &&
+                __column_source_buffer__(
+                    (PyObject *)column->offsets, &src->offsets
+                )
+            )
+        ) {
+            goto fail;
+        }
+        if ((src->type == SQLITE_INTEGER) || (src->type == SQLITE_FLOAT)) {
+            src->format = (src->type == SQLITE_INTEGER) ? 'q' : 'd';
+        }
+        return 0;
+    }
+    if (PyTuple_Check(obj)) {
+        if (
+            !PyArg_ParseTuple(
+                obj, "OO|i:column source", &offsets, &data, &type
+            )
+        ) {
+            return -1;
+        }
+        if ((type != SQLITE_TEXT) && (type != SQLITE_BLOB)) {
+            PyErr_SetString(
+                PyExc_ValueError, "type must be SQLITE_TEXT or SQLITE_BLOB"
+            );
+            return -1;
+        }
+        if (
+            __column_source_buffer__(offsets, &src->offsets) ||
+            __column_source_offsets__(src) ||
+            PyObject_GetBuffer(data, &src->data, PyBUF_C_CONTIGUOUS)
+        ) {
+            goto fail;
+        }
+        src->type = type;
+        return 0;
+    }
+    if (
+        !__column_source_buffer__(obj, &src->data) &&
+        !__column_source_format__(src, &src->data)
+    ) {
+        src->length = src->data.len / src->data.itemsize;
+        return 0;
+    }
+fail:
+    __column_source_release__(src);
+    return -1;
+}
+
+
+/* does not need the GIL, text and blob values point into the buffers */
+static int
+__column_source_value__(ColumnSource *src, Py_ssize_t row, Value *value)
+{
+    const char *data = src->data.buf;
+    long long start, stop;
+    union {
+        signed char b;
+        unsigned char B;
+        short h;
+        unsigned short H;
+        int i;
+        unsigned int I;
+        long l;
+        unsigned long L;
+        long long q;
+        Py_ssize_t n;
+        float f;
+        double d;
+    } item;
+
+    if (
+        (src->type == SQLITE_NULL) ||
+        (
+            src->nulls.buf &&
+            (((const unsigned char *)src->nulls.buf)[row >> 3] & (1 << (row & 7)))
+        )
+    ) {
+        value->type = SQLITE_NULL;
+        return SQLITE_OK;
+    }
+    if ((src->type == SQLITE_TEXT) || (src->type == SQLITE_BLOB)) {
+        if (src->offsets.itemsize == 4) {
+            start = ((const int *)src->offsets.buf)[row];
+            stop = ((const int *)src->offsets.buf)[row + 1];
+        }
+        else {
+            start = ((const long long *)src->offsets.buf)[row];
+            stop = ((const long long *)src->offsets.buf)[row + 1];
+        }
+        if ((start < 0) || (stop < start) || (stop > src->data.len)) {
+            return SQLITE_RANGE;
+        }
+        value->type = src->type;
+        value->value.s = data + start;
+        value->size = stop - start;
+        return SQLITE_OK;
+    }
+    memcpy(&item, data + (row * src->data.itemsize), src->data.itemsize);
+    value->type = SQLITE_INTEGER;
+    switch (src->format) {
+        case '?':
+        case 'B':
+            value->value.l = item.B;
+            break;
+        case 'b':
+            value->value.l = item.b;
+            break;
+        case 'h':
+            value->value.l = item.h;
+            break;
+        case 'H':
+            value->value.l = item.H;
+            break;
+        case 'i':
+            value->value.l = item.i;
+            break;
+        case 'I':
+            value->value.l = item.I;
+            break;
+        case 'l':
+            value->value.l = item.l;
+            break;
+        case 'L':
+            value->value.l = item.L;
+            break;
+        case 'q':
+            value->value.l = item.q;
+            break;
+        case 'n':
+            value->value.l = item.n;
+            break;
+        case 'f':
+            value->type = SQLITE_FLOAT;
+            value->value.d = item.f;
+            break;
+        default:
+            value->type = SQLITE_FLOAT;
+            value->value.d = item.d;
+            break;
+    }
+    return SQLITE_OK;
+}
+
+
+static int
+__stmt_bind_cvalue__(sqlite3_stmt *stmt, int index, Value *value);
+
+
+/* does not need the GIL */
+static int
+__column_source_bind__(
+    ColumnSource *src, sqlite3_stmt *stmt, int index, Py_ssize_t row
+)
+{
+    Value value;
+    int rc = SQLITE_OK;
+
+    if ((rc = __column_source_value__(src, row, &value)) == SQLITE_OK) {
+        rc = __stmt_bind_cvalue__(stmt, index, &value);
+    }
+    return rc;
+}
+
+
+/* --------------------------------------------------------------------------
+   Profile
+   -------------------------------------------------------------------------- */
+
+/* aggregation (keyed on the statement sql) happens in the trace callback,
+   (usually) without the GIL, slow queries are queued and reported later.
+   the profile has its own lock, a connection opened without a mutex has no
+   sqlite3_db_mutex() to rely on */
+
+static size_t
+__profile_hash__(const char *sql)
+{
+    size_t hash = 14695981039346656037ULL;
+
+    for (; *sql; ++sql) {
+        hash = (hash ^ (unsigned char)*sql) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+static ProfileEntry *
+__profile_lookup__(Profile *self, const char *sql)
+{
+    ProfileEntry *entries = NULL, *entry = NULL;
+    size_t hash = __profile_hash__(sql), capacity, mask, i, j;
+
+    if ((self->size + 1) * 2 > self->capacity) {
+        capacity = (self->capacity) ? (self->capacity * 2) : 64;
+        if (!(entries = calloc(capacity, sizeof(ProfileEntry)))) {
+            return NULL;
+        }
+        for (mask = capacity - 1, i = 0; i < self->capacity; ++i) {
+            if (self->entries[i].sql) {
+                for (
+                    j = self->entries[i].hash & mask;
+                    entries[j].sql;
+                    j = (j + 1) & mask
+                );
+                entries[j] = self->entries[i];
+            }
+        }
+        free(self->entries);
+        self->entries = entries;
+        self->capacity = capacity;
+    }
+    for (
+        mask = self->capacity - 1, i = hash & mask;
+        (entry = &self->entries[i])->sql;
+        i = (i + 1) & mask
+    ) {
+        if ((entry->hash == hash) && !strcmp(entry->sql, sql)) {
+            return entry;
+        }
+    }
+    if (!(entry->sql = __strdup__(sql))) {
+        return NULL;
+    }
+    entry->hash = hash;
+    self->size++;
+    return entry;
+}
+
+
+static void
+__profile_reset__(Profile *self)
+{
+    size_t i;
+
+    for (i = 0; i < self->capacity; ++i) {
+        free(self->entries[i].sql);
+    }
+    free(self->entries);
+    self->entries = NULL;
+    self->capacity = 0;
+    self->size = 0;
+}
+
+
+/* executions in flight (start time, rows) are tracked in a small
+   direct-mapped table keyed on the statement, a collision only loses the
+   row count and the precise timing of one execution */
+static inline size_t
+__profile_slot__(const sqlite3_stmt *stmt)
+{
+    return (((uintptr_t)stmt) >> 4) % __PROFILE_INFLIGHT__;
+}
+
+
+static inline void
+__profile_start__(Profile *self, const sqlite3_stmt *stmt)
+{
+    size_t i = __profile_slot__(stmt);
+
+    // triggers report their own start, keep the outermost one
+    if (self->inflight[i].stmt != stmt) {
+        self->inflight[i].stmt = stmt;
+        self->inflight[i].rows = 0;
+        self->inflight[i].start = _PyTime_GetPerfCounter();
+    }
+}
+
+
+static inline void
+__profile_row__(Profile *self, const sqlite3_stmt *stmt)
+{
+    size_t i = __profile_slot__(stmt);
+
+    if (self->inflight[i].stmt != stmt) {
+        self->inflight[i].stmt = stmt;
+        self->inflight[i].rows = 0;
+        self->inflight[i].start = 0;
+    }
+    self->inflight[i].rows++;
+}
+
+
+static inline unsigned long long
+__profile_end__(Profile *self, const sqlite3_stmt *stmt, unsigned long long *elapsed)
+{
+    size_t i = __profile_slot__(stmt);
+    unsigned long long rows = 0;
+
+    if (self->inflight[i].stmt == stmt) {
+        rows = self->inflight[i].rows;
+        if (self->inflight[i].start) {
+            *elapsed = (unsigned long long)(
+                _PyTime_GetPerfCounter() - self->inflight[i].start
+            );
+        }
+        self->inflight[i].stmt = NULL;
+        self->inflight[i].rows = 0;
+        self->inflight[i].start = 0;
+    }
+    return rows;
+}
+
+
+static void
+__profile_record__(Profile *self, unsigned type, sqlite3_stmt *stmt, void *x)
+{
+    ProfileEntry *entry = NULL;
+    SlowQuery *slow = NULL;
+    const char *sql = NULL;
+    unsigned long long elapsed = 0, rows = 0;
+
+    switch (type) {
+        case SQLITE_TRACE_STMT:
+            __profile_start__(self, stmt);
+            return;
+        case SQLITE_TRACE_ROW:
+            __profile_row__(self, stmt);
+            return;
+    }
+    // sqlite's own timing has a millisecond resolution
+    elapsed = (unsigned long long)*(sqlite3_int64 *)x;
+    rows = __profile_end__(self, stmt, &elapsed);
+    if (!(sql = sqlite3_sql(stmt)) || !(entry = __profile_lookup__(self, sql))) {
+        return;
+    }
+    entry->calls++;
+    entry->rows += rows;
+    entry->steps += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+    entry->fullscans += sqlite3_stmt_status(
+        stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1
+    );
+    entry->sorts += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+    entry->autoindexes += sqlite3_stmt_status(
+        stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1
+    );
+    entry->total += elapsed;
+    if (elapsed > entry->max) {
+        entry->max = elapsed;
+    }
+    if (
+        self->callback &&
+        (elapsed >= self->threshold) &&
+        (slow = malloc(sizeof(SlowQuery)))
+    ) {
+        if (!(slow->sql = __strdup__(sql))) {
+            free(slow);
+            return;
+        }
+        slow->next = NULL;
+        slow->elapsed = elapsed;
+        slow->rows = rows;
+        *self->tail = slow;
+        self->tail = &slow->next;
+    }
+}
+
+
+static int
+__profile_trace__(unsigned type, void *ctx, void *p, void *x)
+{
+    Profile *self = ctx;
+
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    __profile_record__(self, type, p, x);
+    PyThread_release_lock(self->lock);
+    return 0;
+}
+
+
+static Profile *
+__profile_new__(PyObject *callback, double threshold)
+{
+    Profile *self = NULL;
+
+    if (!(self = PyMem_Calloc(1, sizeof(Profile)))) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    if (!(self->lock = PyThread_allocate_lock())) {
+        PyMem_Free(self);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    self->threshold = (unsigned long long)(threshold * 1e9);
+    self->callback = Py_XNewRef(callback);
+    self->tail = &self->slow;
+    return self;
+}
+
+
+static SlowQuery *
+__profile_slow__(Profile *self)
+{
+    SlowQuery *slow = NULL;
+
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    slow = self->slow;
+    self->slow = NULL;
+    self->tail = &self->slow;
+    PyThread_release_lock(self->lock);
+    return slow;
+}
+
+
+static void
+__profile_free__(Profile *self)
+{
+    SlowQuery *slow = NULL, *next = NULL;
+
+    for (slow = self->slow; slow; slow = next) {
+        next = slow->next;
+        free(slow->sql);
+        free(slow);
+    }
+    __profile_reset__(self);
+    Py_CLEAR(self->callback);
+    PyThread_free_lock(self->lock);
+    PyMem_Free(self);
+}
+
+
+/* --------------------------------------------------------------------------
+   Status
+   -------------------------------------------------------------------------- */
+
+typedef struct {
+    const char *name;
+    int op;
+    int highwater;
+} StatusField;
+
+
+static const StatusField __db_status_fields__[] = {
+    {"cache_used", SQLITE_DBSTATUS_CACHE_USED, 0},
+    {"cache_used_shared", SQLITE_DBSTATUS_CACHE_USED_SHARED, 0},
+    {"cache_hit", SQLITE_DBSTATUS_CACHE_HIT, 0},
+    {"cache_miss", SQLITE_DBSTATUS_CACHE_MISS, 0},
+    {"cache_write", SQLITE_DBSTATUS_CACHE_WRITE, 0},
+    {"cache_spill", SQLITE_DBSTATUS_CACHE_SPILL, 0},
+    {"schema_used", SQLITE_DBSTATUS_SCHEMA_USED, 0},
+    {"stmt_used", SQLITE_DBSTATUS_STMT_USED, 0},
+    {"lookaside_used", SQLITE_DBSTATUS_LOOKASIDE_USED, 0},
+    {"lookaside_used_highwater", SQLITE_DBSTATUS_LOOKASIDE_USED, 1},
+    {"lookaside_hit", SQLITE_DBSTATUS_LOOKASIDE_HIT, 1},
+    {"lookaside_miss_size", SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, 1},
+    {"lookaside_miss_full", SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, 1},
+    {"deferred_fks", SQLITE_DBSTATUS_DEFERRED_FKS, 0},
+    {NULL}
+};
+
+
+static const StatusField __status_fields__[] = {
+    {"memory_used", SQLITE_STATUS_MEMORY_USED, 0},
+    {"memory_used_highwater", SQLITE_STATUS_MEMORY_USED, 1},
+    {"malloc_count", SQLITE_STATUS_MALLOC_COUNT, 0},
+    {"malloc_count_highwater", SQLITE_STATUS_MALLOC_COUNT, 1},
+    {"malloc_size_highwater", SQLITE_STATUS_MALLOC_SIZE, 1},
+    {"pagecache_used", SQLITE_STATUS_PAGECACHE_USED, 0},
+    {"pagecache_used_highwater", SQLITE_STATUS_PAGECACHE_USED, 1},
+    {"pagecache_overflow", SQLITE_STATUS_PAGECACHE_OVERFLOW, 0},
+    {"pagecache_overflow_highwater", SQLITE_STATUS_PAGECACHE_OVERFLOW, 1},
+    {"pagecache_size_highwater", SQLITE_STATUS_PAGECACHE_SIZE, 1},
+    {"parser_stack_highwater", SQLITE_STATUS_PARSER_STACK, 1},
+    {NULL}
+};
+
+
+/* both values of an op are read at once (the next field reuses them when it
+   is the same op), reset only clears the high-water mark (and the resettable
+   counters for db status) */
+static PyObject *
+__status__(sqlite3 *db, const StatusField *fields, int reset)
+{
+    PyObject *result = NULL, *value = NULL;
+    sqlite3_int64 current = 0, highwater = 0;
+    int _current_ = 0, _highwater_ = 0, op = -1, rc = SQLITE_OK;
+
+    if (!(result = PyDict_New())) {
+        return NULL;
+    }
+    for (; fields->name; ++fields) {
+        if (fields->op != op) {
+            op = fields->op;
+            if (db) {
+                rc = sqlite3_db_status(db, op, &_current_, &_highwater_, reset);
+                current = _current_;
+                highwater = _highwater_;
+            }
+            else {
+                rc = sqlite3_status64(op, &current, &highwater, reset);
+            }
+            if (rc != SQLITE_OK) {
+                continue; // not supported by this build
+            }
+        }
+        else if (rc != SQLITE_OK) {
+            continue;
+        }
+        if (
+            !(
+                value = PyLong_FromLongLong(
+                    (fields->highwater) ? highwater : current
+                )
+            ) ||
+            PyDict_SetItemString(result, fields->name, value)
+        ) {
+            Py_XDECREF(value);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(value);
+    }
+    return result;
+}
+
+
+/* --------------------------------------------------------------------------
+    Database
+   -------------------------------------------------------------------------- */
+
+static int
+__db_err_occurred__(Database *self)
+{
+    switch(__sqlite_db_errcode__(self->db)) {
+        case SQLITE_OK:
+        case SQLITE_ROW:
+        case SQLITE_DONE:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+
+static void
+_PyErr_FromDatabaseError(Database *self, int code, const char *msg)
+{
+    PyObject *_exc_type_ = NULL, *_exc_value_ = NULL, *_exc_traceback_ = NULL;
+    PyObject *_err_occurred_ = NULL, *_filename_ = NULL;
+
+    if ((_err_occurred_ = PyErr_Occurred())) {
+        PyErr_Fetch(&_exc_type_, &_exc_value_, &_exc_traceback_);
+    }
+    if ((_filename_ = _PyUnicode_DecodeFSDefault(self->filename))) {
+        PyErr_Format(SQLiteError, "[%i] %s: %R", code, msg, _filename_);
+        Py_DECREF(_filename_);
+    }
+    if (_err_occurred_) {
+        _PyErr_ChainExceptions(_exc_type_, _exc_value_, _exc_traceback_);
+    }
+}
+
+
+static void
+_PyErr_FromDatabase(Database *self)
+{
+    _PyErr_FromDatabaseError(
+        self, __sqlite_db_extderr__(self->db), __sqlite_db_errmsg__(self->db)
+    );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static Database *
+__db_alloc__(PyTypeObject *type)
+{
+    Database *self = NULL;
+
+    if ((self = PyObject_GC_NEW(Database, type))) {
+        self->filename = NULL;
+        self->db = NULL;
+        self->cache.map = NULL;
+        self->cache.head = NULL;
+        self->cache.tail = NULL;
+        self->cache.size = 0;
+        self->cache.capacity = __STMT_CACHE_CAPACITY__;
+        self->cache.hits = 0;
+        self->cache.misses = 0;
+        self->cache.evictions = 0;
+        memset(self->tx, 0, sizeof(self->tx));
+        self->depth = 0;
+        self->group_mode = __TX_BEGIN__;
+        self->group_size = 0;
+        self->group_count = 0;
+        self->group_interval = 0;
+        self->group_start = 0;
+        self->worker = NULL;
+        self->profile = NULL;
+        self->tables = NULL;
+        self->natives = NULL;
+        self->share = NULL;
+        self->format = __ROW_STRUCT__;
+        self->intern = 0;
+        self->thread = 0;
+    }
+    return self;
+}
+
+
+static const char *__journal_modes__[] = {
+    "delete", "truncate", "persist", "memory", "wal", "off", NULL
+};
+
+static const char *__synchronous_modes__[] = {
+    "off", "normal", "full", "extra", NULL
+};
+
+static const char *__temp_stores__[] = {
+    "default", "file", "memory", NULL
+};
+
+
+static int
+__pragma_check__(const char *name, const char *value, const char **values)
+{
+    if (value) {
+        for (; *values; ++values) {
+            if (!sqlite3_stricmp(value, *values)) {
+                return 0;
+            }
+        }
+        PyErr_Format(PyExc_ValueError, "invalid %s: '%s'", name, value);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+__capacity_check__(Py_ssize_t capacity)
+{
+    if (capacity < 0) {
+        PyErr_SetString(
+            PyExc_ValueError, "'cached_statements' must be >= 0"
+        );
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+__options_check__(Options *options)
+{
+    if (
+        __pragma_check__(
+            "journal_mode", options->journal_mode, __journal_modes__
+        ) ||
+        __pragma_check__(
+            "synchronous", options->synchronous, __synchronous_modes__
+        ) ||
+        __pragma_check__("temp_store", options->temp_store, __temp_stores__)
+    ) {
+        return -1;
+    }
+    if (
+        options->cache_size &&
+        (options->cache_size != Py_None) &&
+        !PyLong_Check(options->cache_size)
+    ) {
+        PyErr_Format(
+            PyExc_TypeError,
+            "cache_size must be an int or None, not %.200s",
+            Py_TYPE(options->cache_size)->tp_name
+        );
+        return -1;
+    }
+    if (
+        (options->lookaside_count >= 0) &&
+        ((options->lookaside_size < 0) || (options->lookaside_count < 0))
+    ) {
+        PyErr_SetString(PyExc_ValueError, "lookaside values must be >= 0");
+        return -1;
+    }
+    return 0;
+}
+
+
+/* everything is applied in one go, right after open (lookaside can only be
+   configured before the connection allocates anything) */
+static int
+__db_configure__(Database *self, Options *options)
+{
+    char pragmas[512] = "", *p = pragmas;
+    const char *end = pragmas + sizeof(pragmas);
+    long long cache_size = 0;
+    int rc = SQLITE_OK;
+
+    if (
+        (options->lookaside_count >= 0) &&
+        (
+            rc = sqlite3_db_config(
+                self->db,
+                SQLITE_DBCONFIG_LOOKASIDE,
+                NULL,
+                options->lookaside_size,
+                options->lookaside_count
+            )
+        )
+    ) {
+        return rc;
+    }
+    if (
+        (options->busy_timeout >= 0.0) &&
+        (
+            rc = sqlite3_busy_timeout(
+                self->db, (int)(options->busy_timeout * 1000)
+            )
+        )
+    ) {
+        return rc;
+    }
+    if (options->cache_size && (options->cache_size != Py_None)) {
+        if (
+            ((cache_size = PyLong_AsLongLong(options->cache_size)) == -1) &&
+            PyErr_Occurred()
+        ) {
+            return SQLITE_MISUSE;
+        }
+        p += snprintf(p, end - p, "PRAGMA cache_size=%lld;", cache_size);
+    }
+    if (options->mmap_size >= 0) {
+        p += snprintf(p, end - p, "PRAGMA mmap_size=%lld;", options->mmap_size);
+    }
+    if (options->journal_mode) {
+        p += snprintf(p, end - p, "PRAGMA journal_mode=%s;", options->journal_mode);
+    }
+    if (options->synchronous) {
+        p += snprintf(p, end - p, "PRAGMA synchronous=%s;", options->synchronous);
+    }
+    if (options->temp_store) {
+        p += snprintf(p, end - p, "PRAGMA temp_store=%s;", options->temp_store);
+    }
+    if (pragmas[0]) {
+        rc = __sqlite_db_exec__(self->db, pragmas, NULL, NULL, NULL);
+    }
+    return rc;
+}
+
+
+static int
+__db_open__(Database *self, int flags, Options *options)
+{
+    int rc = SQLITE_OK;
+
+    // unless asked otherwise, a connection is used by one thread at a time
+    if (!(flags & (SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_FULLMUTEX))) {
+        flags |= SQLITE_OPEN_NOMUTEX;
+    }
+    rc = __sqlite_db_open__(
+        PyBytes_AS_STRING(self->filename), &self->db, flags, NULL
+    );
+    if ((rc == SQLITE_OK) && options) {
+        rc = __db_configure__(self, options);
+    }
+    if (rc) {
+        if (!PyErr_Occurred()) {
+            _PyErr_FromDatabase(self);
+        }
+        if (self->db) {
+            if (__sqlite_db_close__(self->db)) {
+                _PyErr_FromDatabase(self);
+            }
+            self->db = NULL;
+        }
+    }
+    return (rc != SQLITE_OK) ? -1 : 0;
+}
+
+
+/* every step, prepare, finalize, ... releases the GIL, a connection opened
+   without SQLITE_OPEN_FULLMUTEX must not be used by two threads */
+static inline int
+__db_check_thread__(Database *self)
+{
+    unsigned long thread = 0;
+
+    if (
+        self->thread &&
+        (self->thread != (thread = PyThread_get_thread_ident()))
+    ) {
+        PyErr_Format(
+            ProgrammingError,
+            "connection created in thread %lu used in thread %lu "
+            "(open it with SQLITE_OPEN_FULLMUTEX to share it between threads)",
+            self->thread,
+            thread
+        );
+        return -1;
+    }
+    return 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static Stmt *
+__stmt_new__(Database *self, PyObject *sql)
+{
+    Stmt *entry = NULL;
+    const char *_sql_ = NULL;
+    Py_ssize_t _size_;
+
+    if (!(_sql_ = PyUnicode_AsUTF8AndSize(sql, &_size_))) {
+        return NULL;
+    }
+    if (!(entry = PyMem_Malloc(sizeof(Stmt)))) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    entry->prev = entry->next = NULL;
+    entry->key = Py_NewRef(sql);
+    entry->capsule = NULL;
+    entry->stmt = NULL;
+    entry->rowtype = NULL;
+    entry->columns = NULL;
+    entry->names = NULL;
+    entry->plan = NULL;
+    entry->reprepared = 0;
+    if (
+        __sqlite_stmt_prepare__(
+            self->db, _sql_, _size_ + 1, &entry->stmt, NULL
+        )
+    ) {
+        _PyErr_FromDatabase(self);
+        Py_CLEAR(entry->key);
+        PyMem_Free(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+
+static void
+__plan_free__(Plan *self);
+
+
+static void
+__stmt_free__(Stmt *entry)
+{
+    if (entry->stmt) {
+        // the error (if any) has been reported by the last step
+        __sqlite_stmt_finalize__(entry->stmt);
+        entry->stmt = NULL;
+    }
+    Py_CLEAR(entry->rowtype);
+    Py_CLEAR(entry->columns);
+    Py_CLEAR(entry->names);
+    __plan_free__(entry->plan);
+    entry->plan = NULL;
+    Py_CLEAR(entry->capsule);
+    Py_CLEAR(entry->key);
+    PyMem_Free(entry);
+}
+
+
+static inline void
+__stmt_unlink__(StmtCache *cache, Stmt *entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    }
+    else {
+        cache->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    }
+    else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+    cache->size--;
+}
+
+
+static inline void
+__stmt_link__(StmtCache *cache, Stmt *entry)
+{
+    entry->prev = NULL;
+    if ((entry->next = cache->head)) {
+        cache->head->prev = entry;
+    }
+    else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+    cache->size++;
+}
+
+
+static int
+__stmt_evict__(StmtCache *cache, Py_ssize_t capacity)
+{
+    Stmt *entry = NULL;
+
+    while (cache->size > capacity) {
+        entry = cache->tail;
+        if (PyDict_DelItem(cache->map, entry->key)) {
+            return -1;
+        }
+        __stmt_unlink__(cache, entry);
+        __stmt_free__(entry);
+        cache->evictions++;
+    }
+    return 0;
+}
+
+
+static void
+__stmt_cache_clear__(StmtCache *cache)
+{
+    Stmt *entry = NULL;
+
+    while ((entry = cache->head)) {
+        __stmt_unlink__(cache, entry);
+        __stmt_free__(entry);
+    }
+    if (cache->map) {
+        PyDict_Clear(cache->map);
+    }
+}
+
+
+/* take a statement out of the cache (or prepare a new one), the caller owns it
+   until it is handed back with __stmt_release__() */
+static Stmt *
+__stmt_acquire__(Database *self, PyObject *sql)
+{
+    StmtCache *cache = &self->cache;
+    PyObject *capsule = NULL;
+    Stmt *entry = NULL;
+
+    if ((capsule = PyDict_GetItemWithError(cache->map, sql))) {
+        entry = PyCapsule_GetPointer(capsule, NULL);
+        if (PyDict_DelItem(cache->map, sql)) {
+            return NULL;
+        }
+        __stmt_unlink__(cache, entry);
+        cache->hits++;
+        return entry;
+    }
+    if (PyErr_Occurred()) {
+        return NULL;
+    }
+    cache->misses++;
+    return __stmt_new__(self, sql);
+}
+
+
+static int
+__stmt_recycle__(Database *self, Stmt *entry)
+{
+    StmtCache *cache = &self->cache;
+    int res = -1;
+
+    if (
+        !entry->stmt ||
+        !self->db ||
+        !cache->map ||
+        (cache->capacity <= 0) ||
+        !PyUnicode_CheckExact(entry->key)
+    ) {
+        __stmt_free__(entry);
+        return 0;
+    }
+    __sqlite_stmt_reset__(entry->stmt);
+    __sqlite_stmt_clear__(entry->stmt);
+    if ((res = PyDict_Contains(cache->map, entry->key))) {
+        // another one is already cached
+        __stmt_free__(entry);
+        return (res < 0) ? -1 : 0;
+    }
+    if (
+        (
+            entry->capsule ||
+            (entry->capsule = PyCapsule_New(entry, NULL, NULL))
+        ) &&
+        !__stmt_evict__(cache, cache->capacity - 1) &&
+        !PyDict_SetItem(cache->map, entry->key, entry->capsule)
+    ) {
+        __stmt_link__(cache, entry);
+        return 0;
+    }
+    __stmt_free__(entry);
+    return -1;
+}
+
+
+static void
+__db_profile_report__(Database *self);
+
+
+static int
+__stmt_release__(Database *self, Stmt *entry)
+{
+    int res = __stmt_recycle__(self, entry);
+
+    if (self->profile) {
+        __db_profile_report__(self);
+    }
+    return res;
+}
+
+
+/* --------------------------------------------------------------------------
+   Registry
+   -------------------------------------------------------------------------- */
+
+/* read-only connections are parked (with their statement cache) when closed
+   and handed over to the next Database opening the same file with the same
+   flags and options, which then skips opening, configuring, loading the schema
+   and preparing its statements.
+   a parked connection is dropped if the file changed (inode, mtime, size),
+   its statements if the schema cookie changed.
+   a connection that changed its own state (attached, temp objects, pragmas,
+   functions, ...) is not parked.
+   sharing is opt-in (Database(..., shared=True)), parked connections keep
+   their file open (and mapped) until taken, evicted or dropped with
+   sqlite.clear_shared().
+   the registry is only walked and modified with the GIL held, but freeing a
+   parked connection releases it (finalize, close): a node is always unlinked
+   (and the list left consistent) before being freed */
+
+static Parked *__parked__ = NULL;
+static int __parked_count__ = 0;
+
+
+static void
+__parked_free__(Parked *self)
+{
+    int i;
+
+    __stmt_cache_clear__(&self->cache);
+    Py_CLEAR(self->cache.map);
+    for (i = 0; i < __TX_LAST__; ++i) {
+        if (self->tx[i]) {
+            __sqlite_stmt_finalize__(self->tx[i]);
+        }
+    }
+    if (self->db) {
+        __sqlite_db_close__(self->db);
+    }
+    free(self->key);
+    PyMem_Free(self);
+}
+
+
+static void
+__parked_clear__(void)
+{
+    Parked *parked = NULL;
+
+    while ((parked = __parked__)) {
+        __parked__ = parked->next;
+        __parked_count__--;
+        __parked_free__(parked);
+    }
+}
+
+
+/* the schema cookie, straight from the database header */
+static int
+__parked_cookie__(sqlite3 *db, unsigned int *cookie)
+{
+    sqlite3_file *file = NULL;
+    unsigned char header[4];
+
+    if (
+        (sqlite3_file_control(db, "main", SQLITE_FCNTL_FILE_POINTER, &file)) ||
+        !file ||
+        !file->pMethods ||
+        (file->pMethods->xRead(file, header, 4, 40))
+    ) {
+        return -1;
+    }
+    *cookie = (
+        ((unsigned int)header[0] << 24) |
+        ((unsigned int)header[1] << 16) |
+        ((unsigned int)header[2] << 8) |
+        (unsigned int)header[3]
+    );
+    return 0;
+}
+
+
+/* take the matching parked connection out of the registry (stale ones are
+   dropped on the way) */
+static Parked *
+__parked_take__(Parked *share)
+{
+    Parked **prev = &__parked__, *parked = NULL;
+    unsigned int cookie = 0;
+
+    while ((parked = *prev)) {
+        if (
+            (parked->dev == share->dev) &&
+            (parked->ino == share->ino) &&
+            !strcmp(parked->key, share->key)
+        ) {
+            *prev = parked->next;
+            __parked_count__--;
+            if (
+                (parked->mtime.tv_sec != share->mtime.tv_sec) ||
+                (parked->mtime.tv_nsec != share->mtime.tv_nsec) ||
+                (parked->size != share->size)
+            ) {
+                __parked_free__(parked);
+                return NULL;
+            }
+            if (
+                __parked_cookie__(parked->db, &cookie) ||
+                (cookie != parked->cookie)
+            ) {
+                __stmt_cache_clear__(&parked->cache);
+            }
+            return parked;
+        }
+        prev = &parked->next;
+    }
+    return NULL;
+}
+
+
+/* anything that changes the connection state taints it */
+static int
+__parked_authorizer__(
+    void *arg,
+    int action,
+    const char *arg1,
+    const char *arg2,
+    const char *schema,
+    const char *trigger
+)
+{
+    Parked *share = arg;
+
+    switch (action) {
+        case SQLITE_PRAGMA:
+            if (!arg2) {
+                break;
+            }
+            // fallthrough
+        case SQLITE_ATTACH:
+        case SQLITE_DETACH:
+        case SQLITE_CREATE_TEMP_INDEX:
+        case SQLITE_CREATE_TEMP_TABLE:
+        case SQLITE_CREATE_TEMP_TRIGGER:
+        case SQLITE_CREATE_TEMP_VIEW:
+            share->tainted = 1;
+            break;
+        default:
+            break;
+    }
+    return SQLITE_OK;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static int
+__db_share__(Database *self, int flags, Options *options)
+{
+    const char *filename = PyBytes_AS_STRING(self->filename);
+    PyObject *key = NULL;
+    const char *_key_ = NULL;
+    struct stat st;
+
+    if (
+        ((flags & (SQLITE_OPEN_READONLY | SQLITE_OPEN_READWRITE)) != SQLITE_OPEN_READONLY) ||
+        (flags & SQLITE_OPEN_MEMORY) ||
+        !strncmp(filename, "file:", 5) ||
+        stat(filename, &st) ||
+        !S_ISREG(st.st_mode)
+    ) {
+        return 0;
+    }
+    if (
+        !(key = Py_BuildValue(
+            "(izzzLOdii)",
+            flags,
+            options->journal_mode,
+            options->synchronous,
+            options->temp_store,
+            options->mmap_size,
+            (options->cache_size) ? options->cache_size : Py_None,
+            options->busy_timeout,
+            options->lookaside_size,
+            options->lookaside_count
+        ))
+    ) {
+        return -1;
+    }
+    Py_SETREF(key, PyObject_Repr(key));
+    if (!key || !(_key_ = PyUnicode_AsUTF8(key))) {
+        Py_XDECREF(key);
+        return -1;
+    }
+    if (!(self->share = PyMem_Calloc(1, sizeof(Parked)))) {
+        Py_DECREF(key);
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (!(self->share->key = __strdup__(_key_))) {
+        Py_DECREF(key);
+        PyMem_Free(self->share);
+        self->share = NULL;
+        PyErr_NoMemory();
+        return -1;
+    }
+    Py_DECREF(key);
+    self->share->dev = st.st_dev;
+    self->share->ino = st.st_ino;
+    self->share->mtime = st.st_mtim;
+    self->share->size = st.st_size;
+    return 0;
+}
+
+
+/* the connection state can't be handed over anymore */
+static void
+__db_unshare__(Database *self)
+{
+    if (self->share) {
+        if (self->db) {
+            sqlite3_set_authorizer(self->db, NULL, NULL);
+        }
+        free(self->share->key);
+        PyMem_Free(self->share);
+        self->share = NULL;
+    }
+}
+
+
+/* adopt a parked connection (if any), returns 1 if adopted */
+static int
+__db_unpark__(Database *self)
+{
+    Parked *parked = NULL;
+
+    if (!(parked = __parked_take__(self->share))) {
+        return 0;
+    }
+    Py_SETREF(self->cache.map, parked->cache.map);
+    self->cache.head = parked->cache.head;
+    self->cache.tail = parked->cache.tail;
+    self->cache.size = parked->cache.size;
+    memcpy(self->tx, parked->tx, sizeof(self->tx));
+    self->db = parked->db;
+    parked->cache.map = NULL;
+    parked->cache.head = parked->cache.tail = NULL;
+    parked->cache.size = 0;
+    memset(parked->tx, 0, sizeof(parked->tx));
+    parked->db = NULL;
+    __parked_free__(parked);
+    if (__stmt_evict__(&self->cache, Py_MAX(self->cache.capacity, 0))) {
+        PyErr_Clear();
+    }
+    self->cache.evictions = 0;
+    return 1;
+}
+
+
+/* park the connection, returns 1 if parked */
+static int
+__db_park__(Database *self)
+{
+    Parked *share = self->share, **prev = NULL, *victim = NULL;
+    sqlite3_stmt *stmt = NULL;
+    Py_ssize_t cached = 0;
+    int i;
+
+    if (
+        !share ||
+        share->tainted ||
+        !self->db ||
+        !self->cache.map ||
+        self->profile ||
+        self->tables ||
+        !__sqlite_db_autocommit__(self->db) ||
+        __parked_cookie__(self->db, &share->cookie)
+    ) {
+        __db_unshare__(self);
+        return 0;
+    }
+    // every statement left must be in the cache (or be a tx one)
+    for (
+        stmt = sqlite3_next_stmt(self->db, NULL);
+        stmt;
+        stmt = sqlite3_next_stmt(self->db, stmt)
+    ) {
+        for (i = 0; (i < __TX_LAST__) && (self->tx[i] != stmt); ++i);
+        cached += (i == __TX_LAST__);
+    }
+    if (cached != self->cache.size) {
+        __db_unshare__(self);
+        return 0;
+    }
+    // the oldest parked connection makes room (freed once we're linked)
+    if (__parked_count__ >= __PARKED_CAPACITY__) {
+        for (prev = &__parked__; (*prev)->next; prev = &(*prev)->next);
+        victim = *prev;
+        *prev = NULL;
+        __parked_count__--;
+    }
+    share->db = self->db;
+    share->cache = self->cache;
+    memcpy(share->tx, self->tx, sizeof(self->tx));
+    share->next = __parked__;
+    __parked__ = share;
+    __parked_count__++;
+    self->share = NULL;
+    self->db = NULL;
+    self->cache.map = NULL;
+    self->cache.head = self->cache.tail = NULL;
+    self->cache.size = 0;
+    memset(self->tx, 0, sizeof(self->tx));
+    if (victim) {
+        __parked_free__(victim);
+    }
+    return 1;
+}
+
+
+static int
+__db_connect__(Database *self, int flags, Options *options, int shared)
+{
+    if (shared && __db_share__(self, flags, options)) {
+        return -1;
+    }
+    if (!self->share || !__db_unpark__(self)) {
+        if (__db_open__(self, flags, options)) {
+            __db_unshare__(self);
+            return -1;
+        }
+    }
+    if (self->share) {
+        sqlite3_set_authorizer(self->db, __parked_authorizer__, self->share);
+    }
+    // without a mutex, only the opening thread may use the connection
+    self->thread = sqlite3_db_mutex(self->db) ? 0 : PyThread_get_thread_ident();
+    return 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static void
+__worker_stop__(Database *self);
+
+
+static int
+__db_close__(Database *self)
+{
+    int rc = SQLITE_OK, i;
+
+    __worker_stop__(self);
+    if (__db_park__(self)) {
+        return 0;
+    }
+    __stmt_cache_clear__(&self->cache);
+    for (i = 0; i < __TX_LAST__; ++i) {
+        if (self->tx[i]) {
+            __sqlite_stmt_finalize__(self->tx[i]);
+            self->tx[i] = NULL;
+        }
+    }
+    if (self->db) {
+        if ((rc = __sqlite_db_close__(self->db))) {
+            _PyErr_FromDatabase(self);
+        }
+        self->db = NULL;
+    }
+    if (self->profile) {
+        __profile_free__(self->profile);
+        self->profile = NULL;
+    }
+    return (rc != SQLITE_OK) ? -1 : 0;
+}
+
+
+static const char *__tx_sql__[__TX_LAST__] = {
+    [__TX_BEGIN__] = "BEGIN",
+    [__TX_BEGIN_IMMEDIATE__] = "BEGIN IMMEDIATE",
+    [__TX_BEGIN_EXCLUSIVE__] = "BEGIN EXCLUSIVE",
+    [__TX_COMMIT__] = "COMMIT",
+    [__TX_ROLLBACK__] = "ROLLBACK",
+};
+
+
+static int
+__db_tx__(Database *self, int op)
+{
+    sqlite3_stmt **stmt = &self->tx[op];
+    int rc = SQLITE_OK;
+
+    if (
+        !*stmt &&
+        __sqlite_stmt_prepare__(self->db, __tx_sql__[op], -1, stmt, NULL)
+    ) {
+        _PyErr_FromDatabase(self);
+        return -1;
+    }
+    rc = __sqlite_stmt_step__(*stmt);
+    __sqlite_stmt_reset__(*stmt);
+    if (rc != SQLITE_DONE) {
+        _PyErr_FromDatabase(self);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+__db_tx_end__(Database *self, int failed)
+{
+    if (failed || __db_tx__(self, __TX_COMMIT__)) {
+        if (!__sqlite_db_autocommit__(self->db)) {
+            __db_tx__(self, __TX_ROLLBACK__);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+
+/* group commit, called after each successful execute() */
+static int
+__db_tx_tick__(Database *self)
+{
+    _PyTime_t now = 0;
+
+    if ((self->depth != 1) || (!self->group_size && !self->group_interval)) {
+        return 0;
+    }
+    self->group_count++;
+    if (
+        (self->group_size && (self->group_count >= self->group_size)) ||
+        (
+            self->group_interval &&
+            (((now = _PyTime_GetPerfCounter()) - self->group_start) >= self->group_interval)
+        )
+    ) {
+        if (
+            !__sqlite_db_autocommit__(self->db) &&
+            (__db_tx__(self, __TX_COMMIT__) || __db_tx__(self, self->group_mode))
+        ) {
+            return -1;
+        }
+        self->group_count = 0;
+        self->group_start = (now) ? now : _PyTime_GetPerfCounter();
+    }
+    return 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+#define __params_size__ PySequence_Fast_GET_SIZE
+#define __params_item__ PySequence_Fast_GET_ITEM
+
+
+static int
+__params_check__(PyObject *params)
+{
+    if (PyList_CheckExact(params) || PyTuple_CheckExact(params)) {
+        return 1;
+    }
+    PyErr_Format(
+        PyExc_TypeError,
+        "parameters must be a list or tuple, not %.200s",
+        Py_TYPE(params)->tp_name
+    );
+    return 0;
+}
+
+
+static int
+__params_converter__(PyObject *arg, void *addr)
+{
+    int res = 0;
+
+    if ((res = __params_check__(arg))) {
+        *(PyObject **)addr = arg;
+    }
+    return res;
+}
+
+
+/* a parameter set is either positional (list or tuple) or named (dict) */
+static int
+__param_set_check__(PyObject *params)
+{
+    if (
+        PyList_CheckExact(params) ||
+        PyTuple_CheckExact(params) ||
+        PyDict_Check(params)
+    ) {
+        return 1;
+    }
+    PyErr_Format(
+        PyExc_TypeError,
+        "parameters must be a list, tuple or dict, not %.200s",
+        Py_TYPE(params)->tp_name
+    );
+    return 0;
+}
+
+
+static int
+__param_set_converter__(PyObject *arg, void *addr)
+{
+    int res = 0;
+
+    if ((res = __param_set_check__(arg))) {
+        *(PyObject **)addr = arg;
+    }
+    return res;
+}
+
+
+static int
+__row_format_converter__(PyObject *arg, void *addr)
+{
+    long format = PyLong_AsLong(arg);
+
+    if ((format == -1) && PyErr_Occurred()) {
+        return 0;
+    }
+    if ((format < 0) || (format >= __ROW_LAST__)) {
+        PyErr_Format(PyExc_ValueError, "invalid row format: %ld", format);
+        return 0;
+    }
+    *(int *)addr = (int)format;
+    return 1;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static PyTypeObject *
+__new_rowtype__(Database *self, sqlite3_stmt *stmt, int len)
+{
+    PyStructSequence_Desc _desc_ = { .name = "mood.sqlite.Row" };
+    PyStructSequence_Field *_fields_ = NULL;
+    PyTypeObject *_type_ = NULL;
+    int i;
+
+    if (!(_fields_ = PyMem_Calloc((len + 1), sizeof(PyStructSequence_Field)))) {
+        goto fail;
+    }
+    for (i = 0; i < len; ++i) {
+        if (!(_fields_[i].name = __strdup__(__sqlite_column_name__(stmt, i)))) {
+            goto fail;
+        }
+    }
+    _desc_.fields = _fields_;
+    _desc_.n_in_sequence = len;
+    if ((_type_ = PyStructSequence_NewType(&_desc_))) {
+        Py_SET_TYPE(_type_, &RowType_Type);
+        PyMem_Free(_fields_);
+        return _type_;
+    }
+fail:
+    if (_fields_) {
+        for (i = 0; i < len; ++i) {
+            if(_fields_[i].name) {
+                free((void *)_fields_[i].name);
+                _fields_[i].name = NULL;
+            }
+        }
+        PyMem_Free(_fields_);
+        _fields_ = NULL;
+    }
+    if (!PyErr_Occurred()) {
+        PyErr_NoMemory();
+    }
+    return NULL;
+}
+
+
+static PyObject *
+__column_value__(Database *self, sqlite3_stmt *stmt, int i)
+{
+    PyObject *value = NULL;
+
+    switch (__sqlite_column_type__(stmt, i)) {
+        case SQLITE_INTEGER:
+            {
+                long long _value_ = __sqlite_column_long__(stmt, i);
+                if (!__db_err_occurred__(self)) {
+                    value = PyLong_FromLongLong(_value_);
+                }
+            }
+            break;
+        case SQLITE_FLOAT:
+            {
+                double _value_ = __sqlite_column_float__(stmt, i);
+                if (!__db_err_occurred__(self)) {
+                    value = PyFloat_FromDouble(_value_);
+                }
+            }
+            break;
+        case SQLITE_TEXT:
+            {
+                const char *_value_ = __sqlite_column_unicode__(stmt, i);
+                if (_value_) {
+                    value = PyUnicode_FromStringAndSize(
+                        _value_, __sqlite_column_size__(stmt, i)
+                    );
+                }
+            }
+            break;
+        case SQLITE_BLOB:
+            {
+                const char *_value_ = __sqlite_column_bytes__(stmt, i);
+                if (_value_) {
+                    value = PyBytes_FromStringAndSize(
+                        _value_, __sqlite_column_size__(stmt, i)
+                    );
+                }
+            }
+            break;
+        case SQLITE_NULL:
+            value = Py_NewRef(Py_None);
+            break;
+        default:
+            PyErr_SetString(PyExc_TypeError, "unknown sqlite3 datatype");
+            break;
+    }
+    if ((value == NULL) && !PyErr_Occurred()) {
+        _PyErr_FromDatabase(self);
+    }
+    return value;
+}
+
+
+static PyObject *
+__new_columns__(sqlite3_stmt *stmt, int len)
+{
+    PyObject *columns = NULL, *name = NULL;
+    int i;
+
+    if ((columns = PyTuple_New(len))) {
+        for (i = 0; i < len; ++i) {
+            if (!(name = PyUnicode_InternFromString(__sqlite_column_name__(stmt, i)))) {
+                Py_CLEAR(columns);
+                break;
+            }
+            PyTuple_SET_ITEM(columns, i, name);
+        }
+    }
+    return columns;
+}
+
+
+/* --------------------------------------------------------------------------
+   Decoder
+   -------------------------------------------------------------------------- */
+
+/* a plan has one decoder per result column, its type comes from the declared
+   type (or the first row), a value of that type is decoded without going
+   through the generic path.
+   with intern enabled, short text and integer values are looked up in a small
+   direct-mapped cache per column (a collision only costs an allocation), the
+   cache is dropped if it doesn't pay off (high cardinality columns) */
+
+static void
+__interned_free__(Interned *self)
+{
+    int i;
+
+    if (self) {
+        for (i = 0; i < __INTERN_SLOTS__; ++i) {
+            Py_XDECREF(self->objs[i]);
+        }
+        PyMem_Free(self);
+    }
+}
+
+
+static void
+__plan_free__(Plan *self)
+{
+    int i;
+
+    if (self) {
+        for (i = 0; i < self->len; ++i) {
+            __interned_free__(self->decoders[i].interned);
+        }
+        PyMem_Free(self);
+    }
+}
+
+
+/* sqlite affinity rules, 0 for numeric or none (the first row decides) */
+static int
+__decltype_type__(const char *decltype)
+{
+    if (decltype) {
+        if (sqlite3_strlike("%INT%", decltype, 0) == 0) {
+            return SQLITE_INTEGER;
+        }
+        if (
+            (sqlite3_strlike("%CHAR%", decltype, 0) == 0) ||
+            (sqlite3_strlike("%CLOB%", decltype, 0) == 0) ||
+            (sqlite3_strlike("%TEXT%", decltype, 0) == 0)
+        ) {
+            return SQLITE_TEXT;
+        }
+        if (sqlite3_strlike("%BLOB%", decltype, 0) == 0) {
+            return SQLITE_BLOB;
+        }
+        if (
+            (sqlite3_strlike("%REAL%", decltype, 0) == 0) ||
+            (sqlite3_strlike("%FLOA%", decltype, 0) == 0) ||
+            (sqlite3_strlike("%DOUB%", decltype, 0) == 0)
+        ) {
+            return SQLITE_FLOAT;
+        }
+    }
+    return 0;
+}
+
+
+/* first is the first row (chunk values) or NULL for the current stmt row */
+static Plan *
+__plan_new__(sqlite3_stmt *stmt, int len, Value *first, int intern)
+{
+    Plan *self = NULL;
+    Decoder *decoder = NULL;
+    int i;
+
+    if (!(self = PyMem_Calloc(1, sizeof(Plan) + (len * sizeof(Decoder))))) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    self->len = len;
+    self->intern = intern;
+    for (i = 0; i < len; ++i) {
+        decoder = &self->decoders[i];
+        if (!(decoder->type = __decltype_type__(sqlite3_column_decltype(stmt, i)))) {
+            decoder->type = (first) ? first[i].type : sqlite3_column_type(stmt, i);
+        }
+        if (
+            intern &&
+            ((decoder->type == SQLITE_TEXT) || (decoder->type == SQLITE_INTEGER))
+        ) {
+            // no cache is not an error
+            decoder->interned = PyMem_Calloc(1, sizeof(Interned));
+        }
+    }
+    return self;
+}
+
+
+static inline void
+__interned_check__(Decoder *decoder)
+{
+    Interned *interned = decoder->interned;
+
+    if (interned->lookups >= __INTERN_PROBE__) {
+        if ((interned->hits * 2) < interned->lookups) {
+            __interned_free__(interned);
+            decoder->interned = NULL;
+        }
+        else {
+            interned->lookups = interned->hits = 0;
+        }
+    }
+}
+
+
+static PyObject *
+__interned_text__(Decoder *decoder, const char *data, Py_ssize_t size)
+{
+    Interned *interned = decoder->interned;
+    unsigned long long key = 14695981039346656037ULL;
+    PyObject *obj = NULL;
+    const char *_data_ = NULL;
+    Py_ssize_t _size_, i;
+    size_t slot;
+
+    if (!interned || (size > __INTERN_SIZE__)) {
+        return PyUnicode_FromStringAndSize(data, size);
+    }
+    for (i = 0; i < size; ++i) {
+        key = (key ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    slot = key & (__INTERN_SLOTS__ - 1);
+    interned->lookups++;
+    if (
+        (obj = interned->objs[slot]) &&
+        (interned->keys[slot] == key) &&
+        (_data_ = PyUnicode_AsUTF8AndSize(obj, &_size_)) &&
+        (_size_ == size) &&
+        !memcmp(_data_, data, size)
+    ) {
+        interned->hits++;
+        return Py_NewRef(obj);
+    }
+    if ((obj = PyUnicode_FromStringAndSize(data, size))) {
+        Py_XSETREF(interned->objs[slot], Py_NewRef(obj));
+        interned->keys[slot] = key;
+        __interned_check__(decoder);
+    }
+    return obj;
+}
+
+
+static PyObject *
+__interned_long__(Decoder *decoder, long long value)
+{
+    Interned *interned = decoder->interned;
+    PyObject *obj = NULL;
+    size_t slot;
+
+    if (!interned) {
+        return PyLong_FromLongLong(value);
+    }
+    slot = (unsigned long long)value & (__INTERN_SLOTS__ - 1);
+    interned->lookups++;
+    if (
+        (obj = interned->objs[slot]) &&
+        (interned->keys[slot] == (unsigned long long)value)
+    ) {
+        interned->hits++;
+        return Py_NewRef(obj);
+    }
+    if ((obj = PyLong_FromLongLong(value))) {
+        Py_XSETREF(interned->objs[slot], Py_NewRef(obj));
+        interned->keys[slot] = (unsigned long long)value;
+        __interned_check__(decoder);
+    }
+    return obj;
+}
+
+
+/* a value of the expected type can't fail to convert, anything else (and an
+   out of memory text) goes through the generic path */
+static inline PyObject *
+__column_decode__(
+    Database *self, Decoder *decoder, sqlite3_stmt *stmt, int i
+)
+{
+    const char *data = NULL;
+
+    if (sqlite3_column_type(stmt, i) == decoder->type) {
+        switch (decoder->type) {
+            case SQLITE_INTEGER:
+                return __interned_long__(
+                    decoder, sqlite3_column_int64(stmt, i)
+                );
+            case SQLITE_FLOAT:
+                return PyFloat_FromDouble(sqlite3_column_double(stmt, i));
+            case SQLITE_TEXT:
+                if ((data = (const char *)sqlite3_column_text(stmt, i))) {
+                    return __interned_text__(
+                        decoder, data, sqlite3_column_bytes(stmt, i)
+                    );
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return __column_value__(self, stmt, i);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* the row layout (row type or column names) and the decoder plan are kept
+   with the statement, they only have to be rebuilt when sqlite had to
+   reprepare it (the result columns may have changed), borrowed reference */
+static PyObject *
+__stmt_layout__(
+    Database *self, Stmt *entry, int len, int format, Value *first
+)
+{
+    int reprepared = __sqlite_stmt_status__(
+        entry->stmt, SQLITE_STMTSTATUS_REPREPARE, 0
+    );
+
+    if (entry->reprepared != reprepared) {
+        Py_CLEAR(entry->rowtype);
+        Py_CLEAR(entry->columns);
+        __plan_free__(entry->plan);
+        entry->plan = NULL;
+        entry->reprepared = reprepared;
+    }
+    if (entry->plan && (entry->plan->intern != self->intern)) {
+        __plan_free__(entry->plan);
+        entry->plan = NULL;
+    }
+    if (
+        !entry->plan &&
+        !(entry->plan = __plan_new__(entry->stmt, len, first, self->intern))
+    ) {
+        return NULL;
+    }
+    switch (format) {
+        case __ROW_STRUCT__:
+            if (!entry->rowtype) {
+                entry->rowtype = __new_rowtype__(self, entry->stmt, len);
+            }
+            return (PyObject *)entry->rowtype;
+        case __ROW_DICT__:
+            if (!entry->columns) {
+                entry->columns = __new_columns__(entry->stmt, len);
+            }
+            return entry->columns;
+        default:
+            return Py_None;
+    }
+}
+
+
+static PyObject *
+__stmt_row_new__(
+    Database *self, Stmt *entry, int len, PyTypeObject *rowtype
+)
+{
+    Decoder *decoders = entry->plan->decoders;
+    PyObject *row = NULL, *value = NULL;
+    int i;
+
+    if ((row = PyStructSequence_New(rowtype))) {
+        for (i = 0; i < len; ++i) {
+            if (!(value = __column_decode__(self, &decoders[i], entry->stmt, i))) {
+                Py_CLEAR(row);
+                break;
+            }
+            PyStructSequence_SET_ITEM(row, i, value); // steals ref to value
+        }
+    }
+    return row;
+}
+
+
+static PyObject *
+__stmt_row_tuple__(Database *self, Stmt *entry, int len)
+{
+    Decoder *decoders = entry->plan->decoders;
+    PyObject *row = NULL, *value = NULL;
+    int i;
+
+    if ((row = PyTuple_New(len))) {
+        for (i = 0; i < len; ++i) {
+            if (!(value = __column_decode__(self, &decoders[i], entry->stmt, i))) {
+                Py_CLEAR(row);
+                break;
+            }
+            PyTuple_SET_ITEM(row, i, value); // steals ref to value
+        }
+    }
+    return row;
+}
+
+
+static PyObject *
+__stmt_row_dict__(
+    Database *self, Stmt *entry, int len, PyObject *columns
+)
+{
+    Decoder *decoders = entry->plan->decoders;
+    PyObject *row = NULL, *value = NULL;
+    int i, res = 0;
+
+    if ((row = _PyDict_NewPresized(len))) {
+        for (i = 0; i < len; ++i) {
+            if (!(value = __column_decode__(self, &decoders[i], entry->stmt, i))) {
+                Py_CLEAR(row);
+                break;
+            }
+            res = PyDict_SetItem(row, PyTuple_GET_ITEM(columns, i), value);
+            Py_DECREF(value);
+            if (res) {
+                Py_CLEAR(row);
+                break;
+            }
+        }
+    }
+    return row;
+}
+
+
+/* scalar and value rows are the first column */
+static inline PyObject *
+__stmt_row_format__(
+    Database *self, Stmt *entry, int len, int format, PyObject *layout
+)
+{
+    switch (format) {
+        case __ROW_STRUCT__:
+            return __stmt_row_new__(self, entry, len, (PyTypeObject *)layout);
+        case __ROW_TUPLE__:
+            return __stmt_row_tuple__(self, entry, len);
+        case __ROW_DICT__:
+            return __stmt_row_dict__(self, entry, len, layout);
+        default:
+            return __column_decode__(
+                self, &entry->plan->decoders[0], entry->stmt, 0
+            );
+    }
+}
+
+
+static int
+__stmt_row__(
+    Database *self,
+    Stmt *entry,
+    int len,
+    PyObject *rows,
+    int format,
+    PyObject *layout
+)
+{
+    PyObject *row = NULL;
+    int rc = -1;
+
+    if ((row = __stmt_row_format__(self, entry, len, format, layout))) {
+        rc = PyList_Append(rows, row);
+        Py_DECREF(row);
+    }
+    return rc;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* everything up to __chunk_rows__() runs without the GIL */
+
+static void
+__chunk_init__(Chunk *chunk)
+{
+    memset(chunk, 0, sizeof(Chunk));
+}
+
+
+static void
+__chunk_free__(Chunk *chunk)
+{
+    PyMem_RawFree(chunk->values);
+    PyMem_RawFree(chunk->data);
+    __chunk_init__(chunk);
+}
+
+
+static int
+__chunk_reserve__(Chunk *chunk, Py_ssize_t rows, int cols)
+{
+    Py_ssize_t capacity = chunk->capacity;
+    Value *values = NULL;
+
+    if ((rows * cols) > capacity) {
+        capacity = Py_MAX(rows * cols, capacity * 2);
+        if (!(values = PyMem_RawRealloc(chunk->values, capacity * sizeof(Value)))) {
+            return SQLITE_NOMEM;
+        }
+        chunk->values = values;
+        chunk->capacity = capacity;
+    }
+    return SQLITE_OK;
+}
+
+
+static int
+__chunk_copy__(Chunk *chunk, Value *value, const void *data, int size)
+{
+    char *_data_ = NULL;
+    size_t _size_ = chunk->size;
+
+    if ((chunk->used + size) > _size_) {
+        while ((chunk->used + size) > _size_) {
+            _size_ = (_size_) ? (_size_ * 2) : 4096;
+        }
+        if (!(_data_ = PyMem_RawRealloc(chunk->data, _size_))) {
+            return SQLITE_NOMEM;
+        }
+        chunk->data = _data_;
+        chunk->size = _size_;
+    }
+    if (size) {
+        memcpy(chunk->data + chunk->used, data, size);
+    }
+    value->value.offset = chunk->used;
+    value->size = size;
+    chunk->used += size;
+    return SQLITE_OK;
+}
+
+
+static int
+__chunk_value__(Chunk *chunk, Value *value, sqlite3_stmt *stmt, int i)
+{
+    const void *data = NULL;
+
+    switch ((value->type = sqlite3_column_type(stmt, i))) {
+        case SQLITE_INTEGER:
+            value->value.l = sqlite3_column_int64(stmt, i);
+            break;
+        case SQLITE_FLOAT:
+            value->value.d = sqlite3_column_double(stmt, i);
+            break;
+        case SQLITE_TEXT:
+            data = sqlite3_column_text(stmt, i);
+            goto copy;
+        case SQLITE_BLOB:
+            data = sqlite3_column_blob(stmt, i);
+copy:
+            if (!data && (sqlite3_errcode(sqlite3_db_handle(stmt)) == SQLITE_NOMEM)) {
+                return SQLITE_NOMEM;
+            }
+            return __chunk_copy__(
+                chunk, value, data, sqlite3_column_bytes(stmt, i)
+            );
+        default:
+            break;
+    }
+    return SQLITE_OK;
+}
+
+
+/* step (at most) max rows into chunk, returns the last sqlite3_step() result
+   (SQLITE_ROW if the statement may have more rows) */
+static int
+__chunk_fill__(Chunk *chunk, sqlite3_stmt *stmt, Py_ssize_t max)
+{
+    Value *values = NULL;
+    int rc = SQLITE_ROW, i;
+
+    chunk->rows = 0;
+    chunk->used = 0;
+    while ((chunk->rows < max) && ((rc = sqlite3_step(stmt)) == SQLITE_ROW)) {
+        if (!chunk->rows) {
+            chunk->cols = sqlite3_column_count(stmt);
+        }
+        if (
+            (
+                rc = __chunk_reserve__(
+                    chunk,
+                    (chunk->rows) ? (chunk->rows + 1) : Py_MIN(max, __FETCH_SIZE__),
+                    chunk->cols
+                )
+            )
+        ) {
+            break;
+        }
+        values = &chunk->values[chunk->rows * chunk->cols];
+        for (i = 0; i < chunk->cols; ++i) {
+            if ((rc = __chunk_value__(chunk, &values[i], stmt, i))) {
+                return rc;
+            }
+        }
+        chunk->rows++;
+        rc = SQLITE_ROW;
+    }
+    return rc;
+}
+
+
+static PyObject *
+__chunk_object__(Chunk *chunk, Value *value)
+{
+    switch (value->type) {
+        case SQLITE_INTEGER:
+            return PyLong_FromLongLong(value->value.l);
+        case SQLITE_FLOAT:
+            return PyFloat_FromDouble(value->value.d);
+        case SQLITE_TEXT:
+            return PyUnicode_FromStringAndSize(
+                chunk->data + value->value.offset, value->size
+            );
+        case SQLITE_BLOB:
+            return PyBytes_FromStringAndSize(
+                chunk->data + value->value.offset, value->size
+            );
+        default:
+            return Py_NewRef(Py_None);
+    }
+}
+
+
+static inline PyObject *
+__chunk_decode__(Chunk *chunk, Decoder *decoder, Value *value)
+{
+    if (decoder->interned && (value->type == decoder->type)) {
+        if (value->type == SQLITE_TEXT) {
+            return __interned_text__(
+                decoder, chunk->data + value->value.offset, value->size
+            );
+        }
+        return __interned_long__(decoder, value->value.l);
+    }
+    return __chunk_object__(chunk, value);
+}
+
+
+static PyObject *
+__chunk_row__(
+    Chunk *chunk, Decoder *decoders, Value *values, int format, PyObject *layout
+)
+{
+    PyObject *row = NULL, *value = NULL;
+    int i, res = 0;
+
+    switch (format) {
+        case __ROW_STRUCT__:
+            row = PyStructSequence_New((PyTypeObject *)layout);
+            break;
+        case __ROW_TUPLE__:
+            row = PyTuple_New(chunk->cols);
+            break;
+        case __ROW_DICT__:
+            row = _PyDict_NewPresized(chunk->cols);
+            break;
+        default:
+            return __chunk_decode__(chunk, &decoders[0], &values[0]);
+    }
+    if (!row) {
+        return NULL;
+    }
+    for (i = 0; i < chunk->cols; ++i) {
+        if (!(value = __chunk_decode__(chunk, &decoders[i], &values[i]))) {
+            Py_DECREF(row);
+            return NULL;
+        }
+        if (format == __ROW_DICT__) {
+            res = PyDict_SetItem(row, PyTuple_GET_ITEM(layout, i), value);
+            Py_DECREF(value);
+            if (res) {
+                Py_DECREF(row);
+                return NULL;
+            }
+        }
+        else {
+            // steals ref to value (a struct sequence is a tuple)
+            PyTuple_SET_ITEM(row, i, value);
+        }
+    }
+    return row;
+}
+
+
+static int
+__chunk_rows__(
+    Chunk *chunk, Plan *plan, int format, PyObject *layout, PyObject *rows
+)
+{
+    PyObject *row = NULL;
+    Py_ssize_t r;
+    int res = 0;
+
+    for (r = 0; r < chunk->rows; ++r) {
+        if (
+            !(
+                row = __chunk_row__(
+                    chunk,
+                    plan->decoders,
+                    &chunk->values[r * chunk->cols],
+                    format,
+                    layout
+                )
+            )
+        ) {
+            return -1;
+        }
+        res = PyList_Append(rows, row);
+        Py_DECREF(row);
+        if (res) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+static int
+__value_from_object__(Value *value, PyObject *obj)
+{
+    if (obj == Py_None) {
+        value->type = SQLITE_NULL;
+    }
+    else if (obj == Py_True) {
+        value->type = SQLITE_INTEGER;
+        value->value.l = 1;
+    }
+    else if (obj == Py_False) {
+        value->type = SQLITE_INTEGER;
+        value->value.l = 0;
+    }
+    else if (PyLong_CheckExact(obj)) {
+        value->type = SQLITE_INTEGER;
+        if (
+            ((value->value.l = PyLong_AsLongLong(obj)) == -1) &&
+            PyErr_Occurred()
+        ) {
+            return -1;
+        }
+    }
+    else if (PyFloat_CheckExact(obj)) {
+        value->type = SQLITE_FLOAT;
+        value->value.d = PyFloat_AS_DOUBLE(obj);
+    }
+    else if (PyUnicode_CheckExact(obj)) {
+        value->type = SQLITE_TEXT;
+        if (!(value->value.s = PyUnicode_AsUTF8AndSize(obj, &value->size))) {
+            return -1;
+        }
+    }
+    else if (PyBytes_CheckExact(obj)) {
+        value->type = SQLITE_BLOB;
+        value->value.s = PyBytes_AS_STRING(obj);
+        value->size = PyBytes_GET_SIZE(obj);
+    }
+    else {
+        PyErr_Format(
+            PyExc_TypeError,
+            "unsupported python type: '%.200s'",
+            Py_TYPE(obj)->tp_name
+        );
+        return -1;
+    }
+    return 0;
+}
+
+
+/* does not need the GIL, the value must outlive the binding */
+static int
+__stmt_bind_cvalue__(sqlite3_stmt *stmt, int index, Value *value)
+{
+    switch (value->type) {
+        case SQLITE_INTEGER:
+            return sqlite3_bind_int64(stmt, index, value->value.l);
+        case SQLITE_FLOAT:
+            return sqlite3_bind_double(stmt, index, value->value.d);
+        case SQLITE_TEXT:
+            return sqlite3_bind_text64(
+                stmt, index, value->value.s, value->size, SQLITE_STATIC, SQLITE_UTF8
+            );
+        case SQLITE_BLOB:
+            return sqlite3_bind_blob64(
+                stmt, index, value->value.s, value->size, SQLITE_STATIC
+            );
+        default:
+            return sqlite3_bind_null(stmt, index);
+    }
+}
+
+
+static int
+__stmt_bind_value__(
+    Database *self, sqlite3_stmt *stmt, int index, PyObject *value
+)
+{
+    Value _value_;
+    int rc = -1;
+
+    if (!__value_from_object__(&_value_, value)) {
+        rc = __stmt_bind_cvalue__(stmt, index, &_value_);
+    }
+    if ((rc != SQLITE_OK) && !PyErr_Occurred()) {
+        _PyErr_FromDatabase(self);
+    }
+    return rc;
+}
+
+
+/* the parameter names (without their prefix) of a statement, looked up once
+   and interned, named parameters are then bound by direct dict lookups */
+static PyObject *
+__stmt_names__(Stmt *entry, int count)
+{
+    PyObject *names = NULL, *name = NULL;
+    const char *_name_ = NULL;
+    int i;
+
+    if (!entry->names) {
+        if (!(names = PyTuple_New(count))) {
+            return NULL;
+        }
+        for (i = 0; i < count; ++i) {
+            if (!(_name_ = __sqlite_bind_name__(entry->stmt, i + 1))) {
+                PyErr_Format(
+                    PyExc_ValueError,
+                    "parameter %d has no name, use a list or tuple",
+                    i + 1
+                );
+                Py_DECREF(names);
+                return NULL;
+            }
+            if (!(name = PyUnicode_InternFromString(_name_ + 1))) {
+                Py_DECREF(names);
+                return NULL;
+            }
+            PyTuple_SET_ITEM(names, i, name);
+        }
+        entry->names = names;
+    }
+    return entry->names;
+}
+
+
+/* borrowed reference, a short positional set returns NULL without an
+   exception (bound as NULL), a key missing from a named set raises */
+static inline PyObject *
+__params_get__(PyObject *params, PyObject *names, int i)
+{
+    PyObject *value = NULL;
+
+    if (names) {
+        if (
+            !(value = PyDict_GetItemWithError(params, PyTuple_GET_ITEM(names, i))) &&
+            !PyErr_Occurred()
+        ) {
+            PyErr_Format(
+                ProgrammingError,
+                "no value supplied for parameter %R",
+                PyTuple_GET_ITEM(names, i)
+            );
+        }
+        return value;
+    }
+    return (i < __params_size__(params)) ? __params_item__(params, i) : NULL;
+}
+
+
+static int
+__stmt_bind_params__(
+    Database *self, Stmt *entry, int count, PyObject *params
+)
+{
+    PyObject *names = NULL, *value = NULL;
+    int i;
+
+    if (PyDict_Check(params) && !(names = __stmt_names__(entry, count))) {
+        return -1;
+    }
+    for (i = 0; i < count; ++i) {
+        if ((value = __params_get__(params, names, i))) {
+            if (__stmt_bind_value__(self, entry->stmt, i + 1, value)) {
+                return -1;
+            }
+        }
+        else if (PyErr_Occurred()) {
+            return -1;
+        }
+        else {
+            break; // a short positional set, the rest stays NULL
+        }
+    }
+    return 0;
+}
+
+
+static int
+__stmt_execute__(
+    Database *self,
+    Stmt *entry,
+    PyObject *params,
+    int format,
+    PyObject **result
+)
+{
+    sqlite3_stmt *stmt = entry->stmt;
+    PyObject *rows = NULL, *layout = NULL;
+    int count = 0, len = 0, rc = SQLITE_OK;
+
+    if (
+        params &&
+        (count = __sqlite_bind_count__(stmt)) &&
+        __stmt_bind_params__(self, entry, count, params)
+    ) {
+        return -1;
+    }
+    if (format == __ROW_VALUE__) {
+        // the first column of the first row, no need to step any further
+        if ((rc = __sqlite_stmt_step__(stmt)) == SQLITE_ROW) {
+            *result = __column_value__(self, stmt, 0);
+        }
+        else if (rc == SQLITE_DONE) {
+            *result = Py_NewRef(Py_None);
+        }
+        else {
+            _PyErr_FromDatabase(self);
+        }
+        return (*result) ? 0 : -1;
+    }
+    if ((rows = PyList_New(0))) {
+        while ((rc = __sqlite_stmt_step__(stmt)) == SQLITE_ROW) {
+            if (
+                (
+                    !layout &&
+                    !(
+                        layout = __stmt_layout__(
+                            self,
+                            entry,
+                            (len = __sqlite_column_count__(stmt)),
+                            format,
+                            NULL
+                        )
+                    )
+                ) ||
+                __stmt_row__(self, entry, len, rows, format, layout)
+            ) {
+                break;
+            }
+        }
+        if (!PyErr_Occurred()) {
+            if (rc == SQLITE_DONE) {
+                *result = Py_NewRef(PyList_GET_SIZE(rows) ? rows : Py_None);
+            }
+            else {
+                _PyErr_FromDatabase(self);
+            }
+        }
+        Py_CLEAR(rows);
+    }
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+
+/* executescript(): statements that need neither parameters nor rows (result
+   columns of a selected statement) are run back to back without the GIL, the
+   others one by one with it. statements are counted from 0, -1 selects the
+   last one */
+
+static void
+__script_free__(Script *self)
+{
+    Py_CLEAR(self->params);
+    PyMem_Free(self->bound);
+    self->bound = NULL;
+    PyMem_Free(self->indexes);
+    self->indexes = NULL;
+    Py_CLEAR(self->results);
+}
+
+
+static int
+__script_init__(Script *self, PyObject *params, PyObject *results)
+{
+    PyObject *indexes = NULL, *item = NULL;
+    Py_ssize_t i;
+
+    if (params && (params != Py_None)) {
+        if (!(self->params = PySequence_Tuple(params))) {
+            return -1;
+        }
+        self->count = PyTuple_GET_SIZE(self->params);
+        if (!(self->bound = PyMem_Calloc(Py_MAX(self->count, 1), 1))) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        for (i = 0; i < self->count; ++i) {
+            if ((item = PyTuple_GET_ITEM(self->params, i)) != Py_None) {
+                if (!__param_set_check__(item)) {
+                    return -1;
+                }
+                self->bound[i] = 1;
+            }
+        }
+    }
+    if (!results || (results == Py_None)) {
+        return (self->results = PyList_New(0)) ? 0 : -1;
+    }
+    if (!(indexes = PySequence_Tuple(results))) {
+        return -1;
+    }
+    self->size = PyTuple_GET_SIZE(indexes);
+    if (
+        !(self->indexes = PyMem_Malloc(Py_MAX(self->size, 1) * sizeof(Py_ssize_t)))
+    ) {
+        Py_DECREF(indexes);
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (i = 0; i < self->size; ++i) {
+        if (
+            ((self->indexes[i] = PyLong_AsSsize_t(PyTuple_GET_ITEM(indexes, i))) == -1) &&
+            PyErr_Occurred()
+        ) {
+            Py_DECREF(indexes);
+            return -1;
+        }
+        if (self->indexes[i] < -1) {
+            PyErr_Format(
+                PyExc_ValueError, "invalid statement index: %zd", self->indexes[i]
+            );
+            Py_DECREF(indexes);
+            return -1;
+        }
+    }
+    Py_DECREF(indexes);
+    if (!(self->results = PyList_New(self->size))) {
+        return -1;
+    }
+    for (i = 0; i < self->size; ++i) {
+        PyList_SET_ITEM(self->results, i, Py_NewRef(Py_None));
+    }
+    return 0;
+}
+
+
+/* nothing left but whitespace, comments and semicolons */
+static int
+__script_end__(const char *sql)
+{
+    while (*sql) {
+        if (Py_ISSPACE(*sql) || (*sql == ';')) {
+            sql++;
+        }
+        else if ((sql[0] == '-') && (sql[1] == '-')) {
+            while (*sql && (*sql != '\n')) {
+                sql++;
+            }
+        }
+        else if ((sql[0] == '/') && (sql[1] == '*')) {
+            if (!(sql = strstr(sql + 2, "*/"))) {
+                break;
+            }
+            sql += 2;
+        }
+        else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static inline int
+__script_selected__(
+    Script *self, Py_ssize_t i, Py_ssize_t index, const char *tail
+)
+{
+    return (
+        (self->indexes[i] == index) ||
+        ((self->indexes[i] == -1) && __script_end__(tail))
+    );
+}
+
+
+/* called with or without the GIL */
+static int
+__script_rows__(
+    Script *self, Py_ssize_t index, sqlite3_stmt *stmt, const char *tail
+)
+{
+    Py_ssize_t i;
+
+    if (!sqlite3_column_count(stmt)) {
+        return 0;
+    }
+    if (!self->indexes) {
+        return 1;
+    }
+    for (i = 0; i < self->size; ++i) {
+        if (__script_selected__(self, i, index, tail)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/* called without the GIL, stops at (and returns SQLITE_ROW with *stmt
+   prepared) the first statement needing it */
+static int
+__script_run__(
+    sqlite3 *db,
+    Script *self,
+    const char **sql,
+    Py_ssize_t *index,
+    sqlite3_stmt **stmt
+)
+{
+    int rc = SQLITE_OK;
+
+    while ((*sql)[0]) {
+        if ((rc = sqlite3_prepare_v2(db, *sql, -1, stmt, sql)) != SQLITE_OK) {
+            return rc;
+        }
+        if (*stmt) {
+            if (
+                ((*index < self->count) && self->bound[*index]) ||
+                __script_rows__(self, *index, *stmt, *sql)
+            ) {
+                return SQLITE_ROW;
+            }
+            while (sqlite3_step(*stmt) == SQLITE_ROW);
+            // the error (if any) of the last step
+            rc = sqlite3_finalize(*stmt);
+            *stmt = NULL;
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+            (*index)++;
+        }
+    }
+    return SQLITE_DONE;
+}
+
+
+/* the statement handed over by __script_run__(), finalized here */
+static int
+__script_execute__(
+    Database *self,
+    Script *script,
+    Py_ssize_t index,
+    sqlite3_stmt *stmt,
+    const char *tail,
+    int format
+)
+{
+    Stmt entry = { .stmt = stmt, .rowtype = NULL };
+    PyObject *params = NULL, *result = NULL;
+    int count = 0, rc = SQLITE_DONE;
+    Py_ssize_t i;
+
+    if ((index < script->count) && script->bound[index]) {
+        params = PyTuple_GET_ITEM(script->params, index);
+    }
+    if (__script_rows__(script, index, stmt, tail)) {
+        __stmt_execute__(self, &entry, params, format, &result);
+    }
+    else if (
+        !(
+            params &&
+            (count = __sqlite_bind_count__(stmt)) &&
+            __stmt_bind_params__(self, &entry, count, params)
+        )
+    ) {
+        Py_BEGIN_ALLOW_THREADS
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW);
+        Py_END_ALLOW_THREADS
+        if (rc != SQLITE_DONE) {
+            _PyErr_FromDatabase(self);
+        }
+    }
+    Py_CLEAR(entry.rowtype);
+    Py_CLEAR(entry.columns);
+    Py_CLEAR(entry.names);
+    __plan_free__(entry.plan);
+    if (__sqlite_stmt_finalize__(stmt) && !PyErr_Occurred()) {
+        _PyErr_FromDatabase(self);
+    }
+    if (result && !PyErr_Occurred()) {
+        if (!script->indexes) {
+            if (PyList_Append(script->results, result)) {
+                Py_DECREF(result);
+                return -1;
+            }
+        }
+        else {
+            for (i = 0; i < script->size; ++i) {
+                if (
+                    __script_selected__(script, i, index, tail) &&
+                    PyList_SetItem(script->results, i, Py_NewRef(result))
+                ) {
+                    Py_DECREF(result);
+                    return -1;
+                }
+            }
+        }
+    }
+    Py_XDECREF(result);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+
+static int
+__db_execute_cached__(
+    Database *self,
+    PyObject *sql,
+    PyObject *params,
+    int format,
+    PyObject **result
+)
+{
+    Stmt *entry = NULL;
+    int res = 0;
+
+    if (!(entry = __stmt_acquire__(self, sql))) {
+        return -1;
+    }
+    if (entry->stmt) {
+        res = __stmt_execute__(self, entry, params, format, result);
+    }
+    if (__stmt_release__(self, entry) || res) {
+        Py_CLEAR(*result);
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+__db_savepoint__(Database *self, const char *op, int depth)
+{
+    PyObject *sql = NULL, *result = NULL;
+    int res = -1;
+
+    if ((sql = PyUnicode_FromFormat("%s mood_savepoint_%d", op, depth))) {
+        res = __db_execute_cached__(
+            self, sql, NULL, __ROW_STRUCT__, &result
+        );
+        Py_XDECREF(result);
+        Py_DECREF(sql);
+    }
+    return res;
+}
+
+
+/* slow queries are reported with the GIL held, once the statement has been
+   released (the callback is free to use the connection) */
+static void
+__db_profile_report__(Database *self)
+{
+    PyObject *_exc_type_ = NULL, *_exc_value_ = NULL, *_exc_traceback_ = NULL;
+    PyObject *callback = NULL, *res = NULL;
+    SlowQuery *slow = NULL, *next = NULL;
+
+    if (
+        !self->profile->slow ||
+        !(slow = __profile_slow__(self->profile))
+    ) {
+        return;
+    }
+    PyErr_Fetch(&_exc_type_, &_exc_value_, &_exc_traceback_);
+    callback = Py_XNewRef(self->profile->callback);
+    for (; slow; slow = next) {
+        next = slow->next;
+        if (callback) {
+            if (
+                (
+                    res = PyObject_CallFunction(
+                        callback,
+                        "sdK",
+                        slow->sql,
+                        slow->elapsed / 1e9,
+                        slow->rows
+                    )
+                )
+            ) {
+                Py_DECREF(res);
+            }
+            else {
+                PyErr_WriteUnraisable(callback);
+            }
+        }
+        free(slow->sql);
+        free(slow);
+    }
+    Py_XDECREF(callback);
+    PyErr_Restore(_exc_type_, _exc_value_, _exc_traceback_);
+}
+
+
+static int
+__db_profile__(Database *self, int enabled, PyObject *callback, double threshold)
+{
+    Profile *profile = self->profile;
+    PyObject *tmp = NULL;
+    int rc = SQLITE_OK;
+
+    if (!enabled) {
+        if (profile) {
+            // no callback can be running once unregistered
+            rc = sqlite3_trace_v2(self->db, 0, NULL, NULL);
+            self->profile = NULL;
+            __profile_free__(profile);
+        }
+    }
+    else if (profile) {
+        PyThread_acquire_lock(profile->lock, WAIT_LOCK);
+        profile->threshold = (unsigned long long)(threshold * 1e9);
+        tmp = profile->callback;
+        profile->callback = Py_XNewRef(callback);
+        PyThread_release_lock(profile->lock);
+        Py_XDECREF(tmp);
+    }
+    else if ((profile = __profile_new__(callback, threshold))) {
+        if (
+            (
+                rc = sqlite3_trace_v2(
+                    self->db,
+                    SQLITE_TRACE_STMT | SQLITE_TRACE_ROW | SQLITE_TRACE_PROFILE,
+                    __profile_trace__,
+                    profile
+                )
+            ) != SQLITE_OK
+        ) {
+            __profile_free__(profile);
+        }
+        else {
+            self->profile = profile;
+        }
+    }
+    else {
+        return -1;
+    }
+    if (rc != SQLITE_OK) {
+        _PyErr_FromDatabaseError(self, rc, sqlite3_errstr(rc));
+        return -1;
+    }
+    return 0;
+}
+
+
+static PyObject *
+__db_profile_stats__(Database *self, int reset)
+{
+    ProfileEntry *entries = NULL, *entry = NULL;
+    PyObject *result = NULL, *item = NULL;
+    size_t size = 0, i, j;
+
+    if (!(result = PyDict_New()) || !self->profile) {
+        return result;
+    }
+    // copy (or steal) under the lock, build python objects outside of it
+    PyThread_acquire_lock(self->profile->lock, WAIT_LOCK);
+    if (reset) {
+        entries = self->profile->entries;
+        size = self->profile->capacity;
+        self->profile->entries = NULL;
+        self->profile->capacity = 0;
+        self->profile->size = 0;
+    }
+    else if (
+        (size = self->profile->capacity) &&
+        (entries = malloc(size * sizeof(ProfileEntry)))
+    ) {
+        memcpy(entries, self->profile->entries, size * sizeof(ProfileEntry));
+        for (i = 0; i < size; ++i) {
+            if (
+                entries[i].sql &&
+                !(entries[i].sql = __strdup__(entries[i].sql))
+            ) {
+                for (j = 0; j < i; ++j) {
+                    free(entries[j].sql);
+                }
+                free(entries);
+                entries = NULL;
+                break;
+            }
+        }
+    }
+    PyThread_release_lock(self->profile->lock);
+    if (size && !entries) {
+        Py_DECREF(result);
+        return PyErr_NoMemory();
+    }
+    for (i = 0; i < size; ++i) {
+        if (!(entry = &entries[i])->sql || !result) {
+            free(entry->sql);
+            continue;
+        }
+        if (
+            !(
+                item = Py_BuildValue(
+                    "{s:K,s:K,s:d,s:d,s:K,s:K,s:K,s:K}",
+                    "calls", entry->calls,
+                    "rows", entry->rows,
+                    "total", entry->total / 1e9,
+                    "max", entry->max / 1e9,
+                    "steps", entry->steps,
+                    "fullscan_steps", entry->fullscans,
+                    "sorts", entry->sorts,
+                    "autoindexes", entry->autoindexes
+                )
+            ) ||
+            PyDict_SetItemString(result, entry->sql, item)
+        ) {
+            Py_CLEAR(result);
+        }
+        Py_XDECREF(item);
+        free(entry->sql);
+    }
+    free(entries);
+    return result;
+}
+
+
+/* --------------------------------------------------------------------------
+   Worker
+   -------------------------------------------------------------------------- */
+
+/* execute_async() binds the statement and pushes a request on a lock-free
+   stack, the worker thread steps it (and copies the rows) without the GIL and
+   pushes it on the done stack, the event loop is woken up (at most) once per
+   batch of done requests to build the results and resolve the futures.
+   the worker and the caller share the connection, it must have been opened
+   with SQLITE_OPEN_FULLMUTEX (not the default, see __db_open__()) */
+
+static Request *
+__requests_reverse__(Request *req)
+{
+    Request *fifo = NULL, *next = NULL;
+
+    for (; req; req = next) {
+        next = req->next;
+        req->next = fifo;
+        fifo = req;
+    }
+    return fifo;
+}
+
+
+static void
+__requests_push__(_Atomic(Request *) *stack, Request *req)
+{
+    Request *head = atomic_load(stack);
+
+    do {
+        req->next = head;
+    } while (!atomic_compare_exchange_weak(stack, &head, req));
+}
+
+
+static void
+__request_free__(Request *req)
+{
+    Database *db = (Database *)req->db;
+
+    if (req->entry) {
+        if (__stmt_release__(db, req->entry)) {
+            PyErr_WriteUnraisable(req->db);
+        }
+        req->entry = NULL;
+    }
+    __chunk_free__(&req->chunk);
+    free(req->errmsg);
+    Py_CLEAR(req->future);
+    Py_CLEAR(req->params);
+    Py_CLEAR(req->db);
+    PyMem_Free(req);
+}
+
+
+static void
+__request_run__(Request *req)
+{
+    sqlite3 *db = ((Database *)req->db)->db;
+    const char *errmsg = NULL;
+
+    // the caller can use the connection in between, the error must be read
+    // before it gets the (recursive) db mutex back
+    sqlite3_mutex_enter(sqlite3_db_mutex(db));
+    req->rc = __chunk_fill__(
+        &req->chunk,
+        req->entry->stmt,
+        (req->format == __ROW_VALUE__) ? 1 : PY_SSIZE_T_MAX
+    );
+    if ((req->format == __ROW_VALUE__) && (req->rc == SQLITE_ROW)) {
+        req->rc = SQLITE_DONE;
+    }
+    if ((req->rc != SQLITE_DONE) && (req->rc != SQLITE_NOMEM)) {
+        req->errcode = sqlite3_extended_errcode(db);
+        if ((errmsg = sqlite3_errmsg(db))) {
+            req->errmsg = __strdup__(errmsg);
+        }
+    }
+    sqlite3_mutex_leave(sqlite3_db_mutex(db));
+}
+
+
+static void
+__request_complete__(Request *req)
+{
+    PyObject *_exc_type_ = NULL, *_exc_value_ = NULL, *_exc_traceback_ = NULL;
+    PyObject *result = NULL, *res = NULL, *layout = NULL;
+    int done = 0;
+
+    if (!(res = PyObject_CallMethod(req->future, "done", NULL))) {
+        goto fail;
+    }
+    done = PyObject_IsTrue(res);
+    Py_CLEAR(res);
+    if (done) {
+        return; // cancelled
+    }
+    if (req->rc == SQLITE_DONE) {
+        if (!req->chunk.rows) {
+            result = Py_NewRef(Py_None);
+        }
+        else if (req->format == __ROW_VALUE__) {
+            result = __chunk_object__(&req->chunk, &req->chunk.values[0]);
+        }
+        else if (
+            (
+                layout = __stmt_layout__(
+                    (Database *)req->db,
+                    req->entry,
+                    req->chunk.cols,
+                    req->format,
+                    req->chunk.values
+                )
+            ) &&
+            (result = PyList_New(0)) &&
+            __chunk_rows__(
+                &req->chunk, req->entry->plan, req->format, layout, result
+            )
+        ) {
+            Py_CLEAR(result);
+        }
+    }
+    else if (req->rc == SQLITE_NOMEM) {
+        PyErr_NoMemory();
+    }
+    else {
+        _PyErr_FromDatabaseError(
+            (Database *)req->db,
+            req->errcode,
+            (req->errmsg) ? req->errmsg : sqlite3_errstr(req->rc)
+        );
+    }
+    if (result) {
+        res = PyObject_CallMethod(req->future, "set_result", "O", result);
+        Py_DECREF(result);
+    }
+    else {
+        PyErr_Fetch(&_exc_type_, &_exc_value_, &_exc_traceback_);
+        PyErr_NormalizeException(&_exc_type_, &_exc_value_, &_exc_traceback_);
+        if (_exc_traceback_) {
+            PyException_SetTraceback(_exc_value_, _exc_traceback_);
+        }
+        res = PyObject_CallMethod(
+            req->future, "set_exception", "O", _exc_value_
+        );
+        Py_XDECREF(_exc_type_);
+        Py_XDECREF(_exc_value_);
+        Py_XDECREF(_exc_traceback_);
+    }
+    if (res) {
+        Py_DECREF(res);
+        return;
+    }
+fail:
+    PyErr_WriteUnraisable(req->future);
+}
+
+
+/* called by the event loop */
+static PyObject *
+__worker_drain__(Database *self, PyObject *unused)
+{
+    Worker *worker = self->worker;
+    Request *req = NULL, *next = NULL;
+
+    if (worker) {
+        atomic_store(&worker->scheduled, 0);
+        req = __requests_reverse__(atomic_exchange(&worker->done, NULL));
+        for (; req; req = next) {
+            next = req->next;
+            __request_complete__(req);
+            __request_free__(req);
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef __worker_drain_def__ = {
+    "_drain", (PyCFunction)__worker_drain__, METH_NOARGS, NULL
+};
+
+
+static void
+__worker_notify__(Database *self, Worker *worker)
+{
+    PyGILState_STATE state;
+    PyObject *drain = NULL, *res = NULL;
+
+    if (atomic_exchange(&worker->scheduled, 1) || _Py_IsFinalizing()) {
+        return;
+    }
+    state = PyGILState_Ensure();
+    // a stopping worker can't touch self, it may be going away
+    if (!atomic_load(&worker->stop)) {
+        if (
+            !(drain = PyCFunction_New(&__worker_drain_def__, (PyObject *)self)) ||
+            !(
+                res = PyObject_CallMethod(
+                    worker->loop, "call_soon_threadsafe", "O", drain
+                )
+            )
+        ) {
+            PyErr_WriteUnraisable(worker->loop);
+        }
+        Py_XDECREF(res);
+        Py_XDECREF(drain);
+    }
+    PyGILState_Release(state);
+}
+
+
+static void
+__worker_run__(void *arg)
+{
+    Database *self = arg;
+    Worker *worker = self->worker;
+    Request *req = NULL, *next = NULL;
+
+    for (;;) {
+        PyThread_acquire_lock(worker->wakeup, WAIT_LOCK);
+        atomic_store(&worker->signaled, 0);
+        while ((req = atomic_exchange(&worker->pending, NULL))) {
+            for (req = __requests_reverse__(req); req; req = next) {
+                next = req->next;
+                __request_run__(req);
+                __requests_push__(&worker->done, req);
+            }
+            __worker_notify__(self, worker);
+        }
+        if (atomic_load(&worker->stop)) {
+            break;
+        }
+    }
+    PyThread_release_lock(worker->exited);
+}
+
+
+static void
+__worker_signal__(Worker *worker)
+{
+    if (!atomic_exchange(&worker->signaled, 1)) {
+        PyThread_release_lock(worker->wakeup);
+    }
+}
+
+
+static int
+__worker_start__(Database *self, PyObject *loop)
+{
+    Worker *worker = NULL;
+
+    if (!(worker = PyMem_Calloc(1, sizeof(Worker)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    atomic_init(&worker->pending, NULL);
+    atomic_init(&worker->done, NULL);
+    atomic_init(&worker->signaled, 0);
+    atomic_init(&worker->scheduled, 0);
+    atomic_init(&worker->stop, 0);
+    if (
+        !(worker->wakeup = PyThread_allocate_lock()) ||
+        !(worker->exited = PyThread_allocate_lock())
+    ) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    // both locks are held, the worker waits on wakeup and releases exited
+    PyThread_acquire_lock(worker->wakeup, WAIT_LOCK);
+    PyThread_acquire_lock(worker->exited, WAIT_LOCK);
+    worker->loop = Py_NewRef(loop);
+    self->worker = worker;
+    if (
+        PyThread_start_new_thread(__worker_run__, self) ==
+        PYTHREAD_INVALID_THREAD_ID
+    ) {
+        self->worker = NULL;
+        PyErr_SetString(PyExc_RuntimeError, "can't start worker thread");
+        goto fail;
+    }
+    return 0;
+fail:
+    if (worker->wakeup) {
+        PyThread_free_lock(worker->wakeup);
+    }
+    if (worker->exited) {
+        PyThread_free_lock(worker->exited);
+    }
+    Py_CLEAR(worker->loop);
+    PyMem_Free(worker);
+    return -1;
+}
+
+
+static void
+__worker_stop__(Database *self)
+{
+    Worker *worker = self->worker;
+    Request *req = NULL, *next = NULL;
+
+    if (!worker) {
+        return;
+    }
+    atomic_store(&worker->stop, 1);
+    __worker_signal__(worker);
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(worker->exited, WAIT_LOCK);
+    Py_END_ALLOW_THREADS
+    self->worker = NULL;
+    // leftovers (only possible when breaking a reference cycle)
+    req = atomic_exchange(&worker->pending, NULL);
+    for (; req; req = next) {
+        next = req->next;
+        __request_free__(req);
+    }
+    req = atomic_exchange(&worker->done, NULL);
+    for (; req; req = next) {
+        next = req->next;
+        __request_free__(req);
+    }
+    PyThread_free_lock(worker->wakeup);
+    PyThread_free_lock(worker->exited);
+    Py_CLEAR(worker->loop);
+    PyMem_Free(worker);
+}
+
+
+static PyObject *
+__worker_submit__(
+    Database *self, PyObject *sql, PyObject *params, int format
+)
+{
+    PyObject *loop = NULL, *future = NULL, *res = NULL;
+    Request *req = NULL;
+    int count = 0, closed = 0;
+
+    if (
+        !GetRunningLoop &&
+        !(GetRunningLoop = _PyImport_GetModuleAttrString("asyncio", "get_running_loop"))
+    ) {
+        return NULL;
+    }
+    if (!sqlite3_db_mutex(self->db)) {
+        // the worker and the caller would share the connection
+        PyErr_SetString(
+            PyExc_RuntimeError,
+            "execute_async() requires a connection opened with "
+            "SQLITE_OPEN_FULLMUTEX (connections default to SQLITE_OPEN_NOMUTEX), "
+            "e.g. Database(name, SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX)"
+        );
+        return NULL;
+    }
+    if (!(loop = PyObject_CallNoArgs(GetRunningLoop))) {
+        return NULL;
+    }
+    if (self->worker && (self->worker->loop != loop)) {
+        if (!(res = PyObject_CallMethod(self->worker->loop, "is_closed", NULL))) {
+            goto fail;
+        }
+        closed = PyObject_IsTrue(res);
+        Py_CLEAR(res);
+        if (!closed) {
+            PyErr_SetString(
+                PyExc_RuntimeError,
+                "execute_async() is bound to another event loop"
+            );
+            goto fail;
+        }
+        __worker_stop__(self);
+    }
+    if (!self->worker && __worker_start__(self, loop)) {
+        goto fail;
+    }
+    if (!(future = PyObject_CallMethod(loop, "create_future", NULL))) {
+        goto fail;
+    }
+    if (!(req = PyMem_Calloc(1, sizeof(Request)))) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    req->db = Py_NewRef(self);
+    req->future = Py_NewRef(future);
+    req->format = format;
+    __chunk_init__(&req->chunk);
+    if (
+        (
+            params &&
+            !(
+                req->params = PyDict_Check(params) ?
+                PyDict_Copy(params) : PySequence_Tuple(params)
+            )
+        ) ||
+        !(req->entry = __stmt_acquire__(self, sql))
+    ) {
+        goto fail;
+    }
+    if (!req->entry->stmt) {
+        if (!(res = PyObject_CallMethod(future, "set_result", "O", Py_None))) {
+            goto fail;
+        }
+        Py_DECREF(res);
+        __request_free__(req);
+        Py_DECREF(loop);
+        return future;
+    }
+    if (
+        req->params &&
+        (count = __sqlite_bind_count__(req->entry->stmt)) &&
+        __stmt_bind_params__(self, req->entry, count, req->params)
+    ) {
+        goto fail;
+    }
+    __requests_push__(&self->worker->pending, req);
+    __worker_signal__(self->worker);
+    Py_DECREF(loop);
+    return future;
+fail:
+    if (req) {
+        __request_free__(req);
+    }
+    Py_XDECREF(future);
+    Py_DECREF(loop);
+    return NULL;
+}
+
+
+/* run all but the last parameter set with one prepared statement, values are
+   converted with the GIL held and bound/stepped without it, batch by batch */
+static int
+__stmt_execute_batch__(
+    Database *self, Stmt *entry, PyObject *params, Py_ssize_t size
+)
+{
+    sqlite3_stmt *stmt = entry->stmt;
+    Value *values = NULL;
+    PyObject **objs = NULL, *_params_ = NULL, *names = NULL, *value = NULL;
+    Py_ssize_t start, stop, i, j;
+    int count = 0, rc = SQLITE_DONE, res = -1, k;
+
+    count = __sqlite_bind_count__(stmt);
+    if (
+        !(values = PyMem_Calloc(__BATCH_SIZE__ * Py_MAX(count, 1), sizeof(Value))) ||
+        !(objs = PyMem_Calloc(__BATCH_SIZE__, sizeof(PyObject *)))
+    ) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for (start = 0; start < size; start = stop) {
+        stop = Py_MIN(start + __BATCH_SIZE__, size);
+        for (i = start, j = 0; i < stop; ++i, ++j) {
+            if (!__param_set_check__((_params_ = __params_item__(params, i)))) {
+                goto clear;
+            }
+            names = NULL;
+            if (PyDict_Check(_params_) && !(names = __stmt_names__(entry, count))) {
+                goto clear;
+            }
+            // keep the set alive while its values are bound without the GIL
+            objs[j] = Py_NewRef(_params_);
+            for (k = 0; k < count; ++k) {
+                if ((value = __params_get__(_params_, names, k))) {
+                    if (__value_from_object__(&values[(j * count) + k], value)) {
+                        goto clear;
+                    }
+                }
+                else if (PyErr_Occurred()) {
+                    goto clear;
+                }
+                else {
+                    values[(j * count) + k].type = SQLITE_NULL;
+                }
+            }
+        }
+        Py_BEGIN_ALLOW_THREADS
+        for (j = 0; j < (stop - start); ++j) {
+            rc = SQLITE_OK;
+            for (k = 0; k < count; ++k) {
+                if (
+                    (
+                        rc = __stmt_bind_cvalue__(
+                            stmt, k + 1, &values[(j * count) + k]
+                        )
+                    ) != SQLITE_OK
+                ) {
+                    break;
+                }
+            }
+            if (rc == SQLITE_OK) {
+                while ((rc = sqlite3_step(stmt)) == SQLITE_ROW);
+            }
+            sqlite3_reset(stmt);
+            if (rc != SQLITE_DONE) {
+                break;
+            }
+        }
+        sqlite3_clear_bindings(stmt);
+        Py_END_ALLOW_THREADS
+        if (rc != SQLITE_DONE) {
+            _PyErr_FromDatabase(self);
+            goto clear;
+        }
+        for (j = 0; j < (stop - start); ++j) {
+            Py_CLEAR(objs[j]);
+        }
+    }
+    res = 0;
+clear:
+    for (j = 0; j < __BATCH_SIZE__; ++j) {
+        Py_CLEAR(objs[j]);
+    }
+exit:
+    PyMem_Free(objs);
+    PyMem_Free(values);
+    return res;
+}
+
+
+static int
+__db_execute_many__(
+    Database *self,
+    PyObject *sql,
+    PyObject *params,
+    Py_ssize_t size,
+    int format,
+    PyObject **result
+)
+{
+    PyObject *_params_ = __params_item__(params, size - 1);
+    Stmt *entry = NULL;
+    int res = -1;
+
+    if (!(entry = __stmt_acquire__(self, sql))) {
+        return -1;
+    }
+    if (
+        !entry->stmt ||
+        (
+            !__stmt_execute_batch__(self, entry, params, size - 1) &&
+            __param_set_check__(_params_) &&
+            !__stmt_execute__(self, entry, _params_, format, result)
+        )
+    ) {
+        res = 0;
+    }
+    if (__stmt_release__(self, entry) || res) {
+        Py_CLEAR(*result);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Database_Type.tp_finalize */
+static void
+Database_tp_finalize(Database *self)
+{
+    PyObject *_exc_type_ = NULL, *_exc_value_ = NULL, *_exc_traceback_ = NULL;
+
+    PyErr_Fetch(&_exc_type_, &_exc_value_, &_exc_traceback_);
+    if (__db_close__(self)) {
+        PyErr_WriteUnraisable((PyObject *)self);
+    }
+    PyErr_Restore(_exc_type_, _exc_value_, _exc_traceback_);
+}
+
+
+/* Database_Type.tp_traverse */
+static int
+Database_tp_traverse(Database *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->filename);
+    Py_VISIT(self->cache.map);
+    Py_VISIT(self->tables);
+    Py_VISIT(self->natives);
+    if (self->profile) {
+        Py_VISIT(self->profile->callback);
+    }
+    return 0;
+}
+
+
+/* Database_Type.tp_clear */
+static int
+Database_tp_clear(Database *self)
+{
+    __stmt_cache_clear__(&self->cache);
+    Py_CLEAR(self->cache.map);
+    Py_CLEAR(self->tables);
+    Py_CLEAR(self->natives);
+    Py_CLEAR(self->filename);
+    if (self->profile) {
+        Py_CLEAR(self->profile->callback);
+    }
+    return 0;
+}
+
+
+/* Database_Type.tp_dealloc */
+static void
+Database_tp_dealloc(Database *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    Database_tp_clear(self);
+    PyObject_GC_Del(self);
+}
+
+
+/* Database_Type.tp_repr */
+static PyObject *
+Database_tp_repr(Database *self)
+{
+    PyObject *_filename_ = NULL, *result = NULL;
+
+    if ((_filename_ = _PyUnicode_DecodeFSDefault(self->filename))) {
+        result = PyUnicode_FromFormat(
+            "<%s(%R)>", Py_TYPE(self)->tp_name, _filename_
+        );
+        Py_DECREF(_filename_);
+    }
+    return result;
+}
+
+
+/* Database_Type.tp_new */
+static PyObject *
+Database_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "name",
+        "flags",
+        "cached_statements",
+        "journal_mode",
+        "synchronous",
+        "temp_store",
+        "mmap_size",
+        "cache_size",
+        "busy_timeout",
+        "lookaside",
+        "shared",
+        "row_format",
+        "intern",
+        NULL
+    };
+    Options options = {
+        .journal_mode = NULL,
+        .synchronous = NULL,
+        .temp_store = NULL,
+        .mmap_size = __MMAP_SIZE__,
+        .cache_size = NULL,
+        .busy_timeout = -1.0,
+        .lookaside_size = -1,
+        .lookaside_count = -1,
+    };
+    int flags = SQLITE_OPEN_READONLY, shared = 0;
+    Database *self = NULL;
+
+    if ((self = __db_alloc__(type))) {
+        PyObject_GC_Track(self);
+        if (
+            !PyArg_ParseTupleAndKeywords(
+                args,
+                kwargs,
+                "O&|i$nzzzLOd(ii)pO&p:__new__",
+                kwlist,
+                PyUnicode_FSConverter,
+                &self->filename,
+                &flags,
+                &self->cache.capacity,
+                &options.journal_mode,
+                &options.synchronous,
+                &options.temp_store,
+                &options.mmap_size,
+                &options.cache_size,
+                &options.busy_timeout,
+                &options.lookaside_size,
+                &options.lookaside_count,
+                &shared,
+                __row_format_converter__,
+                &self->format,
+                &self->intern
+            ) ||
+            __capacity_check__(self->cache.capacity) ||
+            __options_check__(&options) ||
+            !(self->cache.map = PyDict_New()) ||
+            __db_connect__(
+                self,
+                flags | SQLITE_OPEN_URI | SQLITE_OPEN_EXRESCODE,
+                &options,
+                shared
+            )
+        ) {
+            Py_CLEAR(self);
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Database.execute() */
+static PyObject *
+Database_execute(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "sql", "params", "transaction", "row_format", NULL
+    };
+    PyObject *sql = NULL, *result = NULL, *params = NULL, *_params_ = NULL;
+    Py_ssize_t size = 0;
+    int transaction = 0, format = self->format, res = -1;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args,
+            kwargs,
+            "U|O&$pO&:execute",
+            kwlist,
+            &sql,
+            __params_converter__,
+            &params,
+            &transaction,
+            __row_format_converter__,
+            &format
+        )
+    ) {
+        return NULL;
+    }
+    size = (params) ? __params_size__(params) : 0;
+    if (transaction) {
+        if (!__sqlite_db_autocommit__(self->db)) {
+            transaction = 0; // already in a transaction
+        }
+        else if (__db_tx__(self, __TX_BEGIN__)) {
+            return NULL;
+        }
+    }
+    if (size > 1) {
+        res = __db_execute_many__(self, sql, params, size, format, &result);
+    }
+    else if (
+        !(_params_ = (size) ? __params_item__(params, 0) : NULL) ||
+        __param_set_check__(_params_)
+    ) {
+        res = __db_execute_cached__(self, sql, _params_, format, &result);
+    }
+    if (transaction && __db_tx_end__(self, res)) {
+        Py_CLEAR(result);
+        return NULL;
+    }
+    if (res || __db_tx_tick__(self)) {
+        Py_CLEAR(result);
+        return NULL;
+    }
+    return (result) ? result : Py_NewRef(Py_None);
+}
+
+
+static PyObject *
+__cursor_new__(Database *db, PyObject *sql, PyObject *params, int format);
+
+static PyObject *
+__statement_new__(Database *db, PyObject *sql);
+
+static PyObject *
+__transaction_new__(Database *db, int mode, Py_ssize_t size, double interval);
+
+static PyObject *
+__blob_new__(
+    Database *db,
+    const char *schema,
+    const char *table,
+    const char *column,
+    long long rowid,
+    int readonly
+);
+
+static int
+__function_create__(
+    Database *self,
+    const char *name,
+    int narg,
+    PyObject *callable,
+    int kind,
+    int flags
+);
+
+static int
+__vtable_create__(
+    Database *self, PyObject *name, PyObject *source, PyObject *columns
+);
+
+
+/* Database.iterate() */
+static PyObject *
+Database_iterate(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"sql", "params", "row_format", NULL};
+    PyObject *sql = NULL, *params = NULL;
+    int format = self->format;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "U|O&$O&:iterate", kwlist,
+            &sql, __param_set_converter__, &params,
+            __row_format_converter__, &format
+        )
+    ) {
+        return NULL;
+    }
+    return __cursor_new__(self, sql, params, format);
+}
+
+
+/* Database.prepare() */
+static PyObject *
+Database_prepare(Database *self, PyObject *args)
+{
+    PyObject *sql = NULL;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (!PyArg_ParseTuple(args, "U:prepare", &sql)) {
+        return NULL;
+    }
+    return __statement_new__(self, sql);
+}
+
+
+/* Database.columns() */
+static PyObject *
+Database_columns(Database *self, PyObject *args)
+{
+    PyObject *sql = NULL, *params = NULL, *result = NULL, *column = NULL;
+    ColumnBuilder *cols = NULL;
+    Stmt *entry = NULL;
+    Py_ssize_t rows = 0;
+    int count = 0, len = 0, rc = SQLITE_DONE, i;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTuple(
+            args, "U|O&:columns", &sql, __param_set_converter__, &params
+        ) ||
+        !(entry = __stmt_acquire__(self, sql))
+    ) {
+        return NULL;
+    }
+    if (!entry->stmt) {
+        __stmt_release__(self, entry);
+        return PyList_New(0);
+    }
+    if (
+        (
+            params &&
+            (count = __sqlite_bind_count__(entry->stmt)) &&
+            __stmt_bind_params__(self, entry, count, params)
+        ) ||
+        !(result = PyList_New(0))
+    ) {
+        goto exit;
+    }
+    len = __sqlite_column_count__(entry->stmt);
+    if (!(cols = PyMem_Calloc(Py_MAX(len, 1), sizeof(ColumnBuilder)))) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for (i = 0; i < len; ++i) {
+        cols[i].type = SQLITE_NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    rc = __column_builders_fill__(cols, len, entry->stmt, &rows);
+    Py_END_ALLOW_THREADS
+    if (rc != SQLITE_DONE) {
+        if (rc == SQLITE_NOMEM) {
+            PyErr_NoMemory();
+        }
+        else {
+            _PyErr_FromDatabase(self);
+        }
+        goto exit;
+    }
+    for (i = 0; i < len; ++i) {
+        if (
+            !(
+                column = __column_new__(
+                    &cols[i], __sqlite_column_name__(entry->stmt, i), rows
+                )
+            ) ||
+            PyList_Append(result, column)
+        ) {
+            Py_XDECREF(column);
+            goto exit;
+        }
+        Py_DECREF(column);
+    }
+exit:
+    if (cols) {
+        for (i = 0; i < len; ++i) {
+            __column_builder_free__(&cols[i]);
+        }
+        PyMem_Free(cols);
+    }
+    if (__stmt_release__(self, entry) || PyErr_Occurred()) {
+        Py_CLEAR(result);
+    }
+    return result;
+}
+
+
+/* Database.load() */
+static PyObject *
+Database_load(Database *self, PyObject *args)
+{
+    PyObject *sql = NULL, *columns = NULL, *result = NULL;
+    ColumnSource *srcs = NULL;
+    Stmt *entry = NULL;
+    Py_ssize_t size = 0, length = -1, row = 0, i;
+    int count = 0, transaction = 0, rc = SQLITE_DONE, k;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTuple(
+            args, "U|O&:load", &sql, __params_converter__, &columns
+        )
+    ) {
+        return NULL;
+    }
+    size = (columns) ? __params_size__(columns) : 0;
+    if (!(srcs = PyMem_Calloc(Py_MAX(size, 1), sizeof(ColumnSource)))) {
+        return PyErr_NoMemory();
+    }
+    for (i = 0; i < size; ++i) {
+        if (__column_source_init__(&srcs[i], __params_item__(columns, i))) {
+            size = i;
+            goto exit;
+        }
+        if (srcs[i].length >= 0) {
+            if ((length >= 0) && (srcs[i].length != length)) {
+                PyErr_SetString(
+                    PyExc_ValueError, "columns must have the same length"
+                );
+                size = i + 1;
+                goto exit;
+            }
+            length = srcs[i].length;
+        }
+    }
+    if (!(entry = __stmt_acquire__(self, sql))) {
+        goto exit;
+    }
+    if (entry->stmt) {
+        if (size > (count = __sqlite_bind_count__(entry->stmt))) {
+            PyErr_Format(
+                PyExc_ValueError,
+                "too many columns: statement has %d parameter(s)",
+                count
+            );
+            goto exit;
+        }
+        if (
+            (transaction = __sqlite_db_autocommit__(self->db)) &&
+            __db_tx__(self, __TX_BEGIN__)
+        ) {
+            transaction = 0;
+            goto exit;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        for (row = 0; row < length; ++row) {
+            rc = SQLITE_OK;
+            for (k = 0; k < size; ++k) {
+                if ((rc = __column_source_bind__(&srcs[k], entry->stmt, k + 1, row))) {
+                    break;
+                }
+            }
+            if (rc == SQLITE_OK) {
+                while ((rc = sqlite3_step(entry->stmt)) == SQLITE_ROW);
+            }
+            sqlite3_reset(entry->stmt);
+            if (rc != SQLITE_DONE) {
+                break;
+            }
+        }
+        sqlite3_clear_bindings(entry->stmt);
+        Py_END_ALLOW_THREADS
+        if (rc == SQLITE_RANGE) {
+            PyErr_Format(PyExc_ValueError, "invalid offsets at row %zd", row);
+        }
+        else if (rc != SQLITE_DONE) {
+            _PyErr_FromDatabase(self);
+        }
+    }
+    if (!PyErr_Occurred()) {
+        result = PyLong_FromSsize_t(Py_MAX(length, 0));
+    }
+exit:
+    if (entry && __stmt_release__(self, entry)) {
+        Py_CLEAR(result);
+    }
+    if (transaction && __db_tx_end__(self, (result) ? 0 : -1)) {
+        Py_CLEAR(result);
+    }
+    for (i = 0; i < size; ++i) {
+        __column_source_release__(&srcs[i]);
+    }
+    PyMem_Free(srcs);
+    return result;
+}
+
+
+/* Database.execute_async() */
+static PyObject *
+Database_execute_async(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"sql", "params", "row_format", NULL};
+    PyObject *sql = NULL, *params = NULL;
+    int format = self->format;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "U|O&$O&:execute_async", kwlist,
+            &sql, __param_set_converter__, &params,
+            __row_format_converter__, &format
+        )
+    ) {
+        return NULL;
+    }
+    return __worker_submit__(self, sql, params, format);
+}
+
+
+/* Database.transaction() */
+static PyObject *
+Database_transaction(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"mode", "batch", "interval", NULL};
+    const char *mode = NULL;
+    Py_ssize_t size = 0;
+    double interval = 0.0;
+    int op = __TX_BEGIN__;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "|z$nd:transaction", kwlist, &mode, &size, &interval
+        )
+    ) {
+        return NULL;
+    }
+    if (!mode || !strcmp(mode, "deferred")) {
+        op = __TX_BEGIN__;
+    }
+    else if (!strcmp(mode, "immediate")) {
+        op = __TX_BEGIN_IMMEDIATE__;
+    }
+    else if (!strcmp(mode, "exclusive")) {
+        op = __TX_BEGIN_EXCLUSIVE__;
+    }
+    else {
+        PyErr_Format(
+            PyExc_ValueError,
+            "mode must be 'deferred', 'immediate' or 'exclusive', not '%s'",
+            mode
+        );
+        return NULL;
+    }
+    if ((size < 0) || (interval < 0.0)) {
+        PyErr_SetString(PyExc_ValueError, "batch and interval must be >= 0");
+        return NULL;
+    }
+    return __transaction_new__(self, op, size, interval);
+}
+
+
+/* Database.blob() */
+static PyObject *
+Database_blob(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "table", "column", "rowid", "readonly", "schema", NULL
+    };
+    const char *table = NULL, *column = NULL, *schema = "main";
+    long long rowid = 0;
+    int readonly = 1;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "ssL|p$s:blob", kwlist,
+            &table, &column, &rowid, &readonly, &schema
+        )
+    ) {
+        return NULL;
+    }
+    __db_unshare__(self);
+    return __blob_new__(self, schema, table, column, rowid, readonly);
+}
+
+
+/* backup steps run without the GIL, sleeping in between lets the live
+   workload keep its latency */
+static int
+__db_backup__(
+    Database *self,
+    Database *target,
+    const char *name,
+    int pages,
+    PyObject *progress,
+    int sleep
+)
+{
+    sqlite3_backup *backup = NULL;
+    PyObject *res = NULL;
+    int rc = SQLITE_OK, failed = 0;
+
+    if (
+        !(
+            backup = __sqlite_backup_init__(
+                target->db, "main", self->db, name
+            )
+        )
+    ) {
+        _PyErr_FromDatabase(target);
+        return -1;
+    }
+    do {
+        rc = __sqlite_backup_step__(backup, pages);
+        if (
+            progress &&
+            (
+                (rc == SQLITE_OK) ||
+                (rc == SQLITE_DONE) ||
+                (rc == SQLITE_BUSY) ||
+                (rc == SQLITE_LOCKED)
+            )
+        ) {
+            if (
+                !(
+                    res = PyObject_CallFunction(
+                        progress,
+                        "ii",
+                        __sqlite_backup_remaining__(backup),
+                        __sqlite_backup_pagecount__(backup)
+                    )
+                )
+            ) {
+                failed = 1;
+                break;
+            }
+            Py_DECREF(res);
+        }
+        if ((rc == SQLITE_BUSY) || (rc == SQLITE_LOCKED)) {
+            // don't spin while a writer holds the lock
+            Py_BEGIN_ALLOW_THREADS
+            sqlite3_sleep(Py_MAX(sleep, __BACKUP_BACKOFF__));
+            Py_END_ALLOW_THREADS
+        }
+        else if ((rc == SQLITE_OK) && sleep) {
+            Py_BEGIN_ALLOW_THREADS
+            sqlite3_sleep(sleep);
+            Py_END_ALLOW_THREADS
+        }
+        if (PyErr_CheckSignals()) {
+            failed = 1;
+            break;
+        }
+    } while (
+        (rc == SQLITE_OK) || (rc == SQLITE_BUSY) || (rc == SQLITE_LOCKED)
+    );
+    rc = __sqlite_backup_finish__(backup);
+    if (failed) {
+        return -1;
+    }
+    if (rc != SQLITE_OK) {
+        _PyErr_FromDatabase(target);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Database.backup() */
+static PyObject *
+Database_backup(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "target", "pages_per_step", "progress", "sleep", "name", NULL
+    };
+    PyObject *target = NULL, *progress = NULL;
+    const char *name = "main";
+    int pages = -1;
+    double sleep = 0.0;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O|$iOds:backup", kwlist,
+            &target, &pages, &progress, &sleep, &name
+        )
+    ) {
+        return NULL;
+    }
+    if (!pages) {
+        PyErr_SetString(PyExc_ValueError, "pages_per_step must be != 0");
+        return NULL;
+    }
+    if (sleep < 0.0) {
+        PyErr_SetString(PyExc_ValueError, "sleep must be >= 0");
+        return NULL;
+    }
+    if (progress == Py_None) {
+        progress = NULL;
+    }
+    if (progress && !PyCallable_Check(progress)) {
+        PyErr_SetString(PyExc_TypeError, "progress must be callable");
+        return NULL;
+    }
+    if (PyObject_TypeCheck(target, &Database_Type)) {
+        if (__db_check_thread__((Database *)target)) {
+            return NULL;
+        }
+        if (target == (PyObject *)self) {
+            PyErr_SetString(PyExc_ValueError, "target must be another database");
+            return NULL;
+        }
+        Py_INCREF(target);
+    }
+    else if (
+        !(
+            target = PyObject_CallFunction(
+                (PyObject *)&Database_Type,
+                "Oi",
+                target,
+                SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE
+            )
+        )
+    ) {
+        return NULL;
+    }
+    if (
+        __db_backup__(
+            self, (Database *)target, name, pages, progress, (int)(sleep * 1000)
+        )
+    ) {
+        Py_CLEAR(target);
+    }
+    return target;
+}
+
+
+/* Database.profile() */
+static PyObject *
+Database_profile(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"enabled", "threshold", "callback", NULL};
+    PyObject *callback = NULL;
+    double threshold = 0.0;
+    int enabled = 1;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "|p$dO:profile", kwlist,
+            &enabled, &threshold, &callback
+        )
+    ) {
+        return NULL;
+    }
+    if (callback == Py_None) {
+        callback = NULL;
+    }
+    if (callback && !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+    if (threshold < 0.0) {
+        PyErr_SetString(PyExc_ValueError, "threshold must be >= 0");
+        return NULL;
+    }
+    if (__db_profile__(self, enabled, callback, threshold)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Database.profile_stats() */
+static PyObject *
+Database_profile_stats(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"reset", NULL};
+    int reset = 0;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "|p:profile_stats", kwlist, &reset
+        )
+    ) {
+        return NULL;
+    }
+    return __db_profile_stats__(self, reset);
+}
+
+
+/* Database.status() */
+static PyObject *
+Database_status(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"reset", NULL};
+    int reset = 0;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p:status", kwlist, &reset)) {
+        return NULL;
+    }
+    return __status__(self->db, __db_status_fields__, reset);
+}
+
+
+/* Database.create_function(), create_aggregate(), create_window_function() */
+static PyObject *
+__db_create_function__(
+    Database *self, PyObject *args, PyObject *kwargs, int kind
+)
+{
+    static char *kwlist[] = {
+        "name", "narg", "function", "deterministic", "innocuous", NULL
+    };
+    static const char *formats[] = {
+        "siO|$pp:create_function",
+        "siO|$pp:create_aggregate",
+        "siO|$pp:create_window_function",
+    };
+    PyObject *callable = NULL;
+    const char *name = NULL;
+    int narg = -1, deterministic = 0, innocuous = 0, flags = 0;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, formats[kind], kwlist,
+            &name, &narg, &callable, &deterministic, &innocuous
+        )
+    ) {
+        return NULL;
+    }
+    if (deterministic) {
+        flags |= SQLITE_DETERMINISTIC;
+    }
+    if (innocuous) {
+        flags |= SQLITE_INNOCUOUS;
+    }
+    __db_unshare__(self);
+    if (__function_create__(self, name, narg, callable, kind, flags)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Database.create_function() */
+static PyObject *
+Database_create_function(Database *self, PyObject *args, PyObject *kwargs)
+{
+    return __db_create_function__(self, args, kwargs, __FUNCTION_SCALAR__);
+}
+
+
+/* Database.create_aggregate() */
+static PyObject *
+Database_create_aggregate(Database *self, PyObject *args, PyObject *kwargs)
+{
+    return __db_create_function__(
+        self, args, kwargs, __FUNCTION_AGGREGATE__
+    );
+}
+
+
+/* Database.create_window_function() */
+static PyObject *
+Database_create_window_function(
+    Database *self, PyObject *args, PyObject *kwargs
+)
+{
+    return __db_create_function__(self, args, kwargs, __FUNCTION_WINDOW__);
+}
+
+
+/* Database.virtual_table() */
+static PyObject *
+Database_virtual_table(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"name", "source", "columns", NULL};
+    PyObject *name = NULL, *source = NULL, *columns = NULL;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "UO|$O:virtual_table", kwlist,
+            &name, &source, &columns
+        )
+    ) {
+        return NULL;
+    }
+    if (columns == Py_None) {
+        columns = NULL;
+    }
+    __db_unshare__(self);
+    if (__vtable_create__(self, name, source, columns)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Database.executescript() */
+static PyObject *
+Database_executescript(Database *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "sql", "params", "transaction", "results", "row_format", NULL
+    };
+    Script script = { .params = NULL, .bound = NULL, .indexes = NULL };
+    PyObject *params = NULL, *results = NULL, *result = NULL;
+    sqlite3_stmt *stmt = NULL;
+    const char *sql = NULL;
+    Py_ssize_t index = 0;
+    int transaction = 0, format = self->format, rc = SQLITE_OK, res = -1;
+
+    if (__db_check_thread__(self)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args,
+            kwargs,
+            "s|O$pOO&:executescript",
+            kwlist,
+            &sql,
+            &params,
+            &transaction,
+            &results,
+            __row_format_converter__,
+            &format
+        ) ||
+        __script_init__(&script, params, results)
+    ) {
+        goto exit;
+    }
+    if (transaction) {
+        if (!__sqlite_db_autocommit__(self->db)) {
+            transaction = 0; // already in a transaction
+        }
+        else if (__db_tx__(self, __TX_BEGIN__)) {
+            goto exit;
+        }
+    }
+    while (1) {
+        Py_BEGIN_ALLOW_THREADS
+        rc = __script_run__(self->db, &script, &sql, &index, &stmt);
+        Py_END_ALLOW_THREADS
+        if (rc != SQLITE_ROW) {
+            if (rc == SQLITE_DONE) {
+                res = 0;
+            }
+            else {
+                _PyErr_FromDatabase(self);
+            }
+            break;
+        }
+        if (__script_execute__(self, &script, index++, stmt, sql, format)) {
+            break;
+        }
+    }
+    if ((transaction && __db_tx_end__(self, res)) || res) {
+        goto exit;
+    }
+    result = Py_NewRef(script.results);
+exit:
+    __script_free__(&script);
+    return result;
+}
+
+
+/* Database_Type.tp_methods */
+static PyMethodDef Database_tp_methods[] = {
+    {
+        "execute",
+        (PyCFunction)Database_execute,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "execute_async",
+        (PyCFunction)Database_execute_async,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "iterate",
+        (PyCFunction)Database_iterate,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {"prepare", (PyCFunction)Database_prepare, METH_VARARGS, NULL},
+    {"columns", (PyCFunction)Database_columns, METH_VARARGS, NULL},
+    {"load", (PyCFunction)Database_load, METH_VARARGS, NULL},
+    {
+        "transaction",
+        (PyCFunction)Database_transaction,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "blob",
+        (PyCFunction)Database_blob,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "backup",
+        (PyCFunction)Database_backup,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "profile",
+        (PyCFunction)Database_profile,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "profile_stats",
+        (PyCFunction)Database_profile_stats,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "status",
+        (PyCFunction)Database_status,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "create_function",
+        (PyCFunction)Database_create_function,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "create_aggregate",
+        (PyCFunction)Database_create_aggregate,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "create_window_function",
+        (PyCFunction)Database_create_window_function,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "virtual_table",
+        (PyCFunction)Database_virtual_table,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "executescript",
+        (PyCFunction)Database_executescript,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Database.readonly */
+static PyObject *
+Database_readonly_getter(Database *self, void *closure)
+{
+    return PyBool_FromLong(__sqlite_db_readonly__(self->db, NULL));
+}
+
+
+/* Database.cached_statements */
+static PyObject *
+Database_cached_statements_getter(Database *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->cache.capacity);
+}
+
+static int
+Database_cached_statements_setter(
+    Database *self, PyObject *value, void *closure
+)
+{
+    Py_ssize_t capacity = -1;
+
+    if (!value) {
+        PyErr_SetString(
+            PyExc_TypeError, "cannot delete 'cached_statements' attribute"
+        );
+        return -1;
+    }
+    if (((capacity = PyLong_AsSsize_t(value)) == -1) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (__capacity_check__(capacity)) {
+        return -1;
+    }
+    self->cache.capacity = capacity;
+    return __stmt_evict__(&self->cache, capacity);
+}
+
+
+/* Database.statement_cache */
+static PyObject *
+Database_statement_cache_getter(Database *self, void *closure)
+{
+    return Py_BuildValue(
+        "{s:n,s:n,s:K,s:K,s:K}",
+        "size", self->cache.size,
+        "capacity", self->cache.capacity,
+        "hits", self->cache.hits,
+        "misses", self->cache.misses,
+        "evictions", self->cache.evictions
+    );
+}
+
+
+/* Database.row_format */
+static PyObject *
+Database_row_format_getter(Database *self, void *closure)
+{
+    return PyLong_FromLong(self->format);
+}
+
+static int
+Database_row_format_setter(Database *self, PyObject *value, void *closure)
+{
+    if (!value) {
+        PyErr_SetString(
+            PyExc_TypeError, "cannot delete 'row_format' attribute"
+        );
+        return -1;
+    }
+    return __row_format_converter__(value, &self->format) ? 0 : -1;
+}
+
+
+/* Database.intern */
+static PyObject *
+Database_intern_getter(Database *self, void *closure)
+{
+    return PyBool_FromLong(self->intern);
+}
+
+static int
+Database_intern_setter(Database *self, PyObject *value, void *closure)
+{
+    int intern = 0;
+
+    if (!value) {
+        PyErr_SetString(PyExc_TypeError, "cannot delete 'intern' attribute");
+        return -1;
+    }
+    if ((intern = PyObject_IsTrue(value)) < 0) {
+        return -1;
+    }
+    self->intern = intern;
+    return 0;
+}
+
+
+/* Database_Type.tp_getsets */
+static PyGetSetDef Database_tp_getset[] = {
+    {"readonly", (getter)Database_readonly_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {
+        "cached_statements",
+        (getter)Database_cached_statements_getter,
+        (setter)Database_cached_statements_setter,
+        NULL,
+        NULL
+    },
+    {"statement_cache", (getter)Database_statement_cache_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {
+        "row_format",
+        (getter)Database_row_format_getter,
+        (setter)Database_row_format_setter,
+        NULL,
+        NULL
+    },
+    {
+        "intern",
+        (getter)Database_intern_getter,
+        (setter)Database_intern_setter,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* Database_Type ------------------------------------------------------------ */
+
+static PyTypeObject Database_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.sqlite.Database",
+    .tp_basicsize = sizeof(Database),
+    .tp_dealloc = (destructor)Database_tp_dealloc,
+    .tp_repr = (reprfunc)Database_tp_repr,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
+    .tp_doc = "Database(name[, flags, *, cached_statements=128, journal_mode, synchronous, temp_store, mmap_size=268435456, cache_size, busy_timeout, lookaside, shared=False, row_format=ROW_STRUCT, intern=False])\n\nconnections are opened with SQLITE_OPEN_NOMUTEX (usable from the opening thread only) unless flags include SQLITE_OPEN_FULLMUTEX, which execute_async() requires",
+    .tp_traverse = (traverseproc)Database_tp_traverse,
+    .tp_clear = (inquiry)Database_tp_clear,
+    .tp_methods = Database_tp_methods,
+    .tp_getset = Database_tp_getset,
+    .tp_new = (newfunc)Database_tp_new,
+    .tp_finalize = (destructor)Database_tp_finalize,
+};
+
+
+/* --------------------------------------------------------------------------
+   Cursor
+   -------------------------------------------------------------------------- */
+
+static int
+__cursor_close__(Cursor *self)
+{
+    Stmt *entry = self->entry;
+    int res = 0;
+
+    self->entry = NULL;
+    self->layout = NULL;
+    if (entry) {
+        // bindings refer to params, release the statement first
+        if (self->owner) {
+            __sqlite_stmt_reset__(entry->stmt);
+            __sqlite_stmt_clear__(entry->stmt);
+            self->owner->busy = 0;
+            if (self->db->profile) {
+                __db_profile_report__(self->db);
+            }
+        }
+        else {
+            res = __stmt_release__(self->db, entry);
+        }
+    }
+    Py_CLEAR(self->owner);
+    Py_CLEAR(self->params);
+    __chunk_free__(&self->chunk);
+    return res;
+}
+
+
+static PyObject *
+__cursor_new__(Database *db, PyObject *sql, PyObject *params, int format)
+{
+    Cursor *self = NULL;
+    int count = 0;
+
+    if (!(self = PyObject_GC_New(Cursor, &Cursor_Type))) {
+        return NULL;
+    }
+    self->db = (Database *)Py_NewRef(db);
+    self->owner = NULL;
+    self->params = NULL;
+    self->entry = NULL;
+    self->layout = NULL;
+    self->format = format;
+    self->len = 0;
+    __chunk_init__(&self->chunk);
+    PyObject_GC_Track(self);
+    if (
+        (
+            params &&
+            !(
+                self->params = PyDict_Check(params) ?
+                PyDict_Copy(params) : PySequence_Tuple(params)
+            )
+        ) ||
+        !(self->entry = __stmt_acquire__(db, sql)) ||
+        (
+            self->entry->stmt &&
+            self->params &&
+            (count = __sqlite_bind_count__(self->entry->stmt)) &&
+            __stmt_bind_params__(db, self->entry, count, self->params)
+        )
+    ) {
+        Py_CLEAR(self);
+    }
+    return (PyObject *)self;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Cursor_Type.tp_finalize */
+static void
+Cursor_tp_finalize(Cursor *self)
+{
+    PyObject *_exc_type_ = NULL, *_exc_value_ = NULL, *_exc_traceback_ = NULL;
+
+    PyErr_Fetch(&_exc_type_, &_exc_value_, &_exc_traceback_);
+    if (__cursor_close__(self)) {
+        PyErr_WriteUnraisable((PyObject *)self);
+    }
+    PyErr_Restore(_exc_type_, _exc_value_, _exc_traceback_);
+}
+
+
+/* Cursor_Type.tp_traverse */
+static int
+Cursor_tp_traverse(Cursor *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->db);
+    Py_VISIT(self->owner);
+    Py_VISIT(self->params);
+    return 0;
+}
+
+
+/* Cursor_Type.tp_clear */
+static int
+Cursor_tp_clear(Cursor *self)
+{
+    // hand a borrowed statement back (reset, bindings refer to params)
+    if (self->owner) {
+        if (self->entry) {
+            __sqlite_stmt_reset__(self->entry->stmt);
+            __sqlite_stmt_clear__(self->entry->stmt);
+            self->entry = NULL;
+            self->layout = NULL;
+        }
+        self->owner->busy = 0;
+    }
+    Py_CLEAR(self->owner);
+    Py_CLEAR(self->params);
+    Py_CLEAR(self->db);
+    return 0;
+}
+
+
+/* Cursor_Type.tp_dealloc */
+static void
+Cursor_tp_dealloc(Cursor *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    Cursor_tp_clear(self);
+    __chunk_free__(&self->chunk);
+    PyObject_GC_Del(self);
+}
+
+
+/* Cursor_Type.tp_iternext */
+static PyObject *
+Cursor_tp_iternext(Cursor *self)
+{
+    PyObject *row = NULL;
+    int rc = SQLITE_DONE;
+
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+
+    if (!self->entry || !self->entry->stmt) {
+        __cursor_close__(self);
+        return NULL;
+    }
+    if ((rc = __sqlite_stmt_step__(self->entry->stmt)) == SQLITE_ROW) {
+        if (
+            !self->layout &&
+            !(
+                self->layout = __stmt_layout__(
+                    self->db,
+                    self->entry,
+                    (self->len = __sqlite_column_count__(self->entry->stmt)),
+                    self->format,
+                    NULL
+                )
+            )
+        ) {
+            goto fail;
+        }
+        if (
+            (
+                row = __stmt_row_format__(
+                    self->db,
+                    self->entry,
+                    self->len,
+                    self->format,
+                    self->layout
+                )
+            )
+        ) {
+            return row;
+        }
+        goto fail;
+    }
+    if (rc != SQLITE_DONE) {
+        _PyErr_FromDatabase(self->db);
+    }
+fail:
+    __cursor_close__(self);
+    return NULL;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Cursor.fetchmany() */
+static PyObject *
+Cursor_fetchmany(Cursor *self, PyObject *args)
+{
+    Py_ssize_t size = __FETCH_SIZE__;
+    PyObject *rows = NULL;
+    int rc = SQLITE_DONE;
+
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+
+    if (!PyArg_ParseTuple(args, "|n:fetchmany", &size)) {
+        return NULL;
+    }
+    if (size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be > 0");
+        return NULL;
+    }
+    if (!(rows = PyList_New(0)) || !self->entry || !self->entry->stmt) {
+        return rows;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    rc = __chunk_fill__(&self->chunk, self->entry->stmt, size);
+    Py_END_ALLOW_THREADS
+    if ((rc != SQLITE_ROW) && (rc != SQLITE_DONE)) {
+        if (rc == SQLITE_NOMEM) {
+            PyErr_NoMemory();
+        }
+        else {
+            _PyErr_FromDatabase(self->db);
+        }
+        goto fail;
+    }
+    if (
+        self->chunk.rows &&
+        (
+            (
+                !self->layout &&
+                !(
+                    self->layout = __stmt_layout__(
+                        self->db,
+                        self->entry,
+                        (self->len = self->chunk.cols),
+                        self->format,
+                        self->chunk.values
+                    )
+                )
+            ) ||
+            __chunk_rows__(
+                &self->chunk,
+                self->entry->plan,
+                self->format,
+                self->layout,
+                rows
+            )
+        )
+    ) {
+        goto fail;
+    }
+    if ((rc == SQLITE_DONE) && __cursor_close__(self)) {
+        Py_CLEAR(rows);
+    }
+    return rows;
+fail:
+    Py_CLEAR(rows);
+    __cursor_close__(self);
+    return NULL;
+}
+
+
+/* Cursor.close() */
+static PyObject *
+Cursor_close(Cursor *self)
+{
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+    if (__cursor_close__(self)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Cursor.__enter__() */
+static PyObject *
+Cursor_enter(Cursor *self)
+{
+    return Py_NewRef(self);
+}
+
+
+/* Cursor.__exit__() */
+static PyObject *
+Cursor_exit(Cursor *self, PyObject *args)
+{
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+    if (__cursor_close__(self)) {
+        return NULL;
+    }
+    Py_RETURN_FALSE;
+}
+
+
+/* Cursor_Type.tp_methods */
+static PyMethodDef Cursor_tp_methods[] = {
+    {"fetchmany", (PyCFunction)Cursor_fetchmany, METH_VARARGS, NULL},
+    {"close", (PyCFunction)Cursor_close, METH_NOARGS, NULL},
+    {"__enter__", (PyCFunction)Cursor_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)Cursor_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Cursor.closed */
+static PyObject *
+Cursor_closed_getter(Cursor *self, void *closure)
+{
+    return PyBool_FromLong(!self->entry);
+}
+
+
+/* Cursor_Type.tp_getsets */
+static PyGetSetDef Cursor_tp_getset[] = {
+    {"closed", (getter)Cursor_closed_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {NULL}
+};
+
+
+/* Cursor_Type -------------------------------------------------------------- */
+
+static PyTypeObject Cursor_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.sqlite.Cursor",
+    .tp_basicsize = sizeof(Cursor),
+    .tp_dealloc = (destructor)Cursor_tp_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
+    .tp_traverse = (traverseproc)Cursor_tp_traverse,
+    .tp_clear = (inquiry)Cursor_tp_clear,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)Cursor_tp_iternext,
+    .tp_methods = Cursor_tp_methods,
+    .tp_getset = Cursor_tp_getset,
+    .tp_finalize = (destructor)Cursor_tp_finalize,
+};
+
+
+/* --------------------------------------------------------------------------
+   Statement
+   -------------------------------------------------------------------------- */
+
+/* a statement prepared once and owned by the caller (outside of the cache),
+   calling it only resets, binds and steps. while a Cursor returned by
+   iterate() is open the statement is busy and can't be run again */
+
+static PyObject *
+__statement_new__(Database *db, PyObject *sql)
+{
+    Statement *self = NULL;
+
+    if (!(self = PyObject_GC_New(Statement, &Statement_Type))) {
+        return NULL;
+    }
+    self->db = (Database *)Py_NewRef(db);
+    self->entry = NULL;
+    self->busy = 0;
+    PyObject_GC_Track(self);
+    if (!(self->entry = __stmt_new__(db, sql))) {
+        Py_CLEAR(self);
+    }
+    else if (!self->entry->stmt) {
+        PyErr_SetString(PyExc_ValueError, "empty statement");
+        Py_CLEAR(self);
+    }
+    return (PyObject *)self;
+}
+
+
+static int
+__statement_check_open__(Statement *self)
+{
+    if (!self->entry) {
+        PyErr_SetString(PyExc_ValueError, "statement is closed");
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+__statement_check__(Statement *self)
+{
+    if (__statement_check_open__(self)) {
+        return -1;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "statement is in use");
+        return -1;
+    }
+    return 0;
+}
+
+
+static void
+__statement_close__(Statement *self)
+{
+    Stmt *entry = self->entry;
+
+    // a busy statement is still referenced by its cursor
+    if (entry && !self->busy) {
+        self->entry = NULL;
+        __stmt_free__(entry);
+    }
+}
+
+
+/* Statement_Type.tp_traverse */
+static int
+Statement_tp_traverse(Statement *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->db);
+    return 0;
+}
+
+
+/* Statement_Type.tp_clear */
+static int
+Statement_tp_clear(Statement *self)
+{
+    __statement_close__(self);
+    Py_CLEAR(self->db);
+    return 0;
+}
+
+
+/* Statement_Type.tp_dealloc */
+static void
+Statement_tp_dealloc(Statement *self)
+{
+    PyObject_GC_UnTrack(self);
+    // a borrowing cursor holds a reference, none is left
+    self->busy = 0;
+    Statement_tp_clear(self);
+    PyObject_GC_Del(self);
+}
+
+
+/* Statement_Type.tp_call */
+static PyObject *
+Statement_tp_call(Statement *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"params", "row_format", NULL};
+    PyObject *params = NULL, *result = NULL;
+    int format = self->db->format, res = -1;
+
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "|O&$O&:__call__", kwlist,
+            __param_set_converter__, &params,
+            __row_format_converter__, &format
+        ) ||
+        __statement_check__(self)
+    ) {
+        return NULL;
+    }
+    res = __stmt_execute__(self->db, self->entry, params, format, &result);
+    __sqlite_stmt_reset__(self->entry->stmt);
+    __sqlite_stmt_clear__(self->entry->stmt);
+    if (self->db->profile) {
+        __db_profile_report__(self->db);
+    }
+    if (res || __db_tx_tick__(self->db)) {
+        Py_CLEAR(result);
+        return NULL;
+    }
+    return (result) ? result : Py_NewRef(Py_None);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Statement.iterate() */
+static PyObject *
+Statement_iterate(Statement *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"params", "row_format", NULL};
+    PyObject *params = NULL;
+    Cursor *cursor = NULL;
+    int count = 0, format = self->db->format;
+
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "|O&$O&:iterate", kwlist,
+            __param_set_converter__, &params,
+            __row_format_converter__, &format
+        ) ||
+        __statement_check__(self) ||
+        !(cursor = PyObject_GC_New(Cursor, &Cursor_Type))
+    ) {
+        return NULL;
+    }
+    cursor->db = (Database *)Py_NewRef(self->db);
+    cursor->owner = NULL;
+    cursor->params = NULL;
+    cursor->entry = NULL;
+    cursor->layout = NULL;
+    cursor->format = format;
+    cursor->len = 0;
+    __chunk_init__(&cursor->chunk);
+    PyObject_GC_Track(cursor);
+    if (
+        params &&
+        !(
+            cursor->params = PyDict_Check(params) ?
+            PyDict_Copy(params) : PySequence_Tuple(params)
+        )
+    ) {
+        Py_DECREF(cursor);
+        return NULL;
+    }
+    // from now on closing the cursor resets the statement
+    cursor->owner = (Statement *)Py_NewRef(self);
+    cursor->entry = self->entry;
+    self->busy = 1;
+    if (
+        cursor->params &&
+        (count = __sqlite_bind_count__(self->entry->stmt)) &&
+        __stmt_bind_params__(self->db, self->entry, count, cursor->params)
+    ) {
+        Py_DECREF(cursor);
+        return NULL;
+    }
+    return (PyObject *)cursor;
+}
+
+
+/* Statement.close() */
+static PyObject *
+Statement_close(Statement *self)
+{
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "statement is in use");
+        return NULL;
+    }
+    __statement_close__(self);
+    Py_RETURN_NONE;
+}
+
+
+/* Statement.__enter__() */
+static PyObject *
+Statement_enter(Statement *self)
+{
+    return Py_NewRef(self);
+}
+
+
+/* Statement.__exit__() */
+static PyObject *
+Statement_exit(Statement *self, PyObject *args)
+{
+    if (!Statement_close(self)) {
+        return NULL;
+    }
+    Py_RETURN_FALSE;
+}
+
+
+/* Statement_Type.tp_methods */
+static PyMethodDef Statement_tp_methods[] = {
+    {
+        "iterate",
+        (PyCFunction)Statement_iterate,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {"close", (PyCFunction)Statement_close, METH_NOARGS, NULL},
+    {"__enter__", (PyCFunction)Statement_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)Statement_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Statement.sql */
+static PyObject *
+Statement_sql_getter(Statement *self, void *closure)
+{
+    if (__statement_check_open__(self)) {
+        return NULL;
+    }
+    return Py_NewRef(self->entry->key);
+}
+
+
+/* Statement.parameters */
+static PyObject *
+Statement_parameters_getter(Statement *self, void *closure)
+{
+    PyObject *result = NULL, *name = NULL;
+    const char *_name_ = NULL;
+    int count, i;
+
+    if (__statement_check_open__(self)) {
+        return NULL;
+    }
+    count = __sqlite_bind_count__(self->entry->stmt);
+    // names without their prefix (the keys of a named set)
+    if ((result = PyTuple_New(count))) {
+        for (i = 0; i < count; ++i) {
+            if (!(_name_ = __sqlite_bind_name__(self->entry->stmt, i + 1))) {
+                name = Py_NewRef(Py_None);
+            }
+            else if (!(name = PyUnicode_FromString(_name_ + 1))) {
+                Py_CLEAR(result);
+                break;
+            }
+            PyTuple_SET_ITEM(result, i, name);
+        }
+    }
+    return result;
+}
+
+
+/* Statement.columns */
+static PyObject *
+Statement_columns_getter(Statement *self, void *closure)
+{
+    if (__statement_check_open__(self)) {
+        return NULL;
+    }
+    return __new_columns__(
+        self->entry->stmt, __sqlite_column_count__(self->entry->stmt)
+    );
+}
+
+
+/* Statement.readonly */
+static PyObject *
+Statement_readonly_getter(Statement *self, void *closure)
+{
+    if (__statement_check_open__(self)) {
+        return NULL;
+    }
+    return PyBool_FromLong(sqlite3_stmt_readonly(self->entry->stmt));
+}
+
+
+/* Statement.closed */
+static PyObject *
+Statement_closed_getter(Statement *self, void *closure)
+{
+    return PyBool_FromLong(!self->entry);
+}
+
+
+/* Statement_Type.tp_getsets */
+static PyGetSetDef Statement_tp_getset[] = {
+    {"sql", (getter)Statement_sql_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {
+        "parameters",
+        (getter)Statement_parameters_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "columns",
+        (getter)Statement_columns_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "readonly",
+        (getter)Statement_readonly_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "closed",
+        (getter)Statement_closed_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* Statement_Type ----------------------------------------------------------- */
+
+static PyTypeObject Statement_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.sqlite.Statement",
+    .tp_basicsize = sizeof(Statement),
+    .tp_dealloc = (destructor)Statement_tp_dealloc,
+    .tp_call = (ternaryfunc)Statement_tp_call,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_doc = "Statement(), see Database.prepare(sql)",
+    .tp_traverse = (traverseproc)Statement_tp_traverse,
+    .tp_clear = (inquiry)Statement_tp_clear,
+    .tp_methods = Statement_tp_methods,
+    .tp_getset = Statement_tp_getset,
+};
+
+
+/* --------------------------------------------------------------------------
+   Blob
+   -------------------------------------------------------------------------- */
+
+/* incremental blob I/O, the GIL is released around every read/write so large
+   blobs can be streamed in fixed-size chunks into/from caller buffers */
+
+static PyObject *
+__blob_new__(
+    Database *db,
+    const char *schema,
+    const char *table,
+    const char *column,
+    long long rowid,
+    int readonly
+)
+{
+    Blob *self = NULL;
+
+    if (!(self = PyObject_GC_New(Blob, &Blob_Type))) {
+        return NULL;
+    }
+    self->db = (Database *)Py_NewRef(db);
+    self->blob = NULL;
+    self->size = 0;
+    self->offset = 0;
+    self->failed = 0;
+    PyObject_GC_Track(self);
+    if (
+        __sqlite_blob_open__(
+            db->db, schema, table, column, rowid, !readonly, &self->blob
+        ) != SQLITE_OK
+    ) {
+        _PyErr_FromDatabase(db);
+        Py_CLEAR(self);
+        return NULL;
+    }
+    self->size = __sqlite_blob_bytes__(self->blob);
+    return (PyObject *)self;
+}
+
+
+static int
+__blob_close__(Blob *self)
+{
+    sqlite3_blob *blob = self->blob;
+    int failed = self->failed;
+
+    self->blob = NULL;
+    self->size = 0;
+    self->offset = 0;
+    self->failed = 0;
+    // an error that was already raised is reported again by close
+    if (blob && (__sqlite_blob_close__(blob) != SQLITE_OK) && !failed) {
+        _PyErr_FromDatabase(self->db);
+        return -1;
+    }
+    return 0;
+}
+
+
+static void
+__blob_error__(Blob *self)
+{
+    self->failed = 1;
+    _PyErr_FromDatabase(self->db);
+}
+
+
+static int
+__blob_check__(Blob *self)
+{
+    if (__db_check_thread__(self->db)) {
+        return -1;
+    }
+    if (!self->blob) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed blob");
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+__blob_read__(Blob *self, void *data, int size)
+{
+    if (size > (self->size - self->offset)) {
+        size = self->size - self->offset;
+    }
+    if (
+        (size > 0) &&
+        (__sqlite_blob_read__(self->blob, data, size, self->offset) != SQLITE_OK)
+    ) {
+        __blob_error__(self);
+        return -1;
+    }
+    self->offset += size;
+    return size;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Blob_Type.tp_finalize */
+static void
+Blob_tp_finalize(Blob *self)
+{
+    PyObject *_exc_type_ = NULL, *_exc_value_ = NULL, *_exc_traceback_ = NULL;
+
+    PyErr_Fetch(&_exc_type_, &_exc_value_, &_exc_traceback_);
+    if (__blob_close__(self)) {
+        PyErr_WriteUnraisable((PyObject *)self);
+    }
+    PyErr_Restore(_exc_type_, _exc_value_, _exc_traceback_);
+}
+
+
+/* Blob_Type.tp_traverse */
+static int
+Blob_tp_traverse(Blob *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->db);
+    return 0;
+}
+
+
+/* Blob_Type.tp_clear */
+static int
+Blob_tp_clear(Blob *self)
+{
+    Py_CLEAR(self->db);
+    return 0;
+}
+
+
+/* Blob_Type.tp_dealloc */
+static void
+Blob_tp_dealloc(Blob *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    Blob_tp_clear(self);
+    PyObject_GC_Del(self);
+}
+
+
+/* Blob_Type.tp_as_sequence.sq_length */
+static Py_ssize_t
+Blob_sq_length(Blob *self)
+{
+    return self->size;
+}
+
+
+static PySequenceMethods Blob_as_sequence = {
+    .sq_length = (lenfunc)Blob_sq_length,
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Blob.read() */
+static PyObject *
+Blob_read(Blob *self, PyObject *args)
+{
+    Py_ssize_t size = -1;
+    PyObject *result = NULL;
+    int len = 0;
+
+    if (!PyArg_ParseTuple(args, "|n:read", &size) || __blob_check__(self)) {
+        return NULL;
+    }
+    len = self->size - self->offset;
+    if ((size >= 0) && (size < len)) {
+        len = (int)size;
+    }
+    if (
+        (result = PyBytes_FromStringAndSize(NULL, len)) &&
+        ((len = __blob_read__(self, PyBytes_AS_STRING(result), len)) < 0)
+    ) {
+        Py_CLEAR(result);
+    }
+    return result;
+}
+
+
+/* Blob.readinto() */
+static PyObject *
+Blob_readinto(Blob *self, PyObject *args)
+{
+    Py_buffer view = {NULL, NULL};
+    int len = -1;
+
+    if (!PyArg_ParseTuple(args, "w*:readinto", &view)) {
+        return NULL;
+    }
+    if (!__blob_check__(self)) {
+        len = __blob_read__(self, view.buf, (int)Py_MIN(view.len, INT_MAX));
+    }
+    PyBuffer_Release(&view);
+    return (len < 0) ? NULL : PyLong_FromLong(len);
+}
+
+
+/* Blob.write() */
+static PyObject *
+Blob_write(Blob *self, PyObject *args)
+{
+    Py_buffer view = {NULL, NULL};
+    int len = -1;
+
+    if (!PyArg_ParseTuple(args, "y*:write", &view)) {
+        return NULL;
+    }
+    if (!__blob_check__(self)) {
+        if (view.len > (self->size - self->offset)) {
+            // sqlite can't grow a blob
+            PyErr_SetString(PyExc_ValueError, "data exceeds blob size");
+        }
+        else if (
+            view.len &&
+            (
+                __sqlite_blob_write__(
+                    self->blob, view.buf, (int)view.len, self->offset
+                ) != SQLITE_OK
+            )
+        ) {
+            __blob_error__(self);
+        }
+        else {
+            self->offset += (len = (int)view.len);
+        }
+    }
+    PyBuffer_Release(&view);
+    return (len < 0) ? NULL : PyLong_FromLong(len);
+}
+
+
+/* Blob.seek() */
+static PyObject *
+Blob_seek(Blob *self, PyObject *args)
+{
+    Py_ssize_t offset = 0;
+    int whence = SEEK_SET;
+
+    if (
+        !PyArg_ParseTuple(args, "n|i:seek", &offset, &whence) ||
+        __blob_check__(self)
+    ) {
+        return NULL;
+    }
+    switch (whence) {
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += self->offset;
+            break;
+        case SEEK_END:
+            offset += self->size;
+            break;
+        default:
+            PyErr_Format(PyExc_ValueError, "invalid whence (%d)", whence);
+            return NULL;
+    }
+    if ((offset < 0) || (offset > self->size)) {
+        PyErr_SetString(PyExc_ValueError, "offset out of blob range");
+        return NULL;
+    }
+    self->offset = (int)offset;
+    return PyLong_FromLong(self->offset);
+}
+
+
+/* Blob.tell() */
+static PyObject *
+Blob_tell(Blob *self)
+{
+    if (__blob_check__(self)) {
+        return NULL;
+    }
+    return PyLong_FromLong(self->offset);
+}
+
+
+/* Blob.reopen() */
+static PyObject *
+Blob_reopen(Blob *self, PyObject *args)
+{
+    long long rowid = 0;
+
+    if (!PyArg_ParseTuple(args, "L:reopen", &rowid) || __blob_check__(self)) {
+        return NULL;
+    }
+    if (__sqlite_blob_reopen__(self->blob, rowid) != SQLITE_OK) {
+        // the handle is aborted, it has to be closed
+        __blob_error__(self);
+        __blob_close__(self);
+        return NULL;
+    }
+    self->size = __sqlite_blob_bytes__(self->blob);
+    self->offset = 0;
+    Py_RETURN_NONE;
+}
+
+
+/* Blob.close() */
+static PyObject *
+Blob_close(Blob *self)
+{
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+    if (__blob_close__(self)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Blob.__enter__() */
+static PyObject *
+Blob_enter(Blob *self)
+{
+    return Py_NewRef(self);
+}
+
+
+/* Blob.__exit__() */
+static PyObject *
+Blob_exit(Blob *self, PyObject *args)
+{
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+    if (__blob_close__(self)) {
+        return NULL;
+    }
+    Py_RETURN_FALSE;
+}
+
+
+/* Blob_Type.tp_methods */
+static PyMethodDef Blob_tp_methods[] = {
+    {"read", (PyCFunction)Blob_read, METH_VARARGS, NULL},
+    {"readinto", (PyCFunction)Blob_readinto, METH_VARARGS, NULL},
+    {"write", (PyCFunction)Blob_write, METH_VARARGS, NULL},
+    {"seek", (PyCFunction)Blob_seek, METH_VARARGS, NULL},
+    {"tell", (PyCFunction)Blob_tell, METH_NOARGS, NULL},
+    {"reopen", (PyCFunction)Blob_reopen, METH_VARARGS, NULL},
+    {"close", (PyCFunction)Blob_close, METH_NOARGS, NULL},
+    {"__enter__", (PyCFunction)Blob_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)Blob_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Blob.closed */
+static PyObject *
+Blob_closed_getter(Blob *self, void *closure)
+{
+    return PyBool_FromLong(!self->blob);
+}
+
+
+/* Blob_Type.tp_getsets */
+static PyGetSetDef Blob_tp_getset[] = {
+    {"closed", (getter)Blob_closed_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {NULL}
+};
+
+
+/* Blob_Type ---------------------------------------------------------------- */
+
+static PyTypeObject Blob_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.sqlite.Blob",
+    .tp_basicsize = sizeof(Blob),
+    .tp_dealloc = (destructor)Blob_tp_dealloc,
+    .tp_as_sequence = &Blob_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
+    .tp_traverse = (traverseproc)Blob_tp_traverse,
+    .tp_clear = (inquiry)Blob_tp_clear,
+    .tp_methods = Blob_tp_methods,
+    .tp_getset = Blob_tp_getset,
+    .tp_finalize = (destructor)Blob_tp_finalize,
+};
+
+
+/* --------------------------------------------------------------------------
+   Function
+   -------------------------------------------------------------------------- */
+
+/* user-defined functions are called with the GIL (they usually run from
+   within a step that released it), a failing function fails the statement */
+
+#define __FUNCTION_CAPSULE__ "mood.sqlite.function"
+
+typedef void (*xFunc)(sqlite3_context *, int, sqlite3_value **);
+
+
+static PyObject *
+__value_object__(sqlite3_value *value)
+{
+    const void *data = NULL;
+
+    switch (sqlite3_value_type(value)) {
+        case SQLITE_INTEGER:
+            return PyLong_FromLongLong(sqlite3_value_int64(value));
+        case SQLITE_FLOAT:
+            return PyFloat_FromDouble(sqlite3_value_double(value));
+        case SQLITE_TEXT:
+            if (!(data = sqlite3_value_text(value))) {
+                return PyErr_NoMemory();
+            }
+            return PyUnicode_FromStringAndSize(
+                data, sqlite3_value_bytes(value)
+            );
+        case SQLITE_BLOB:
+            // a zero-length blob is NULL
+            data = sqlite3_value_blob(value);
+            return PyBytes_FromStringAndSize(
+                data, (data) ? sqlite3_value_bytes(value) : 0
+            );
+        default:
+            return Py_NewRef(Py_None);
+    }
+}
+
+
+static PyObject *
+__function_args__(int argc, sqlite3_value **argv)
+{
+    PyObject *args = NULL, *arg = NULL;
+    int i;
+
+    if ((args = PyTuple_New(argc))) {
+        for (i = 0; i < argc; ++i) {
+            if (!(arg = __value_object__(argv[i]))) {
+                Py_CLEAR(args);
+                break;
+            }
+            PyTuple_SET_ITEM(args, i, arg);
+        }
+    }
+    return args;
+}
+
+
+/* consumes the current exception, the result must be freed with sqlite3_free
+   (NULL means out of memory) */
+static char *
+__error_string__(void)
+{
+    PyObject *_exc_type_ = NULL, *_exc_value_ = NULL, *_exc_traceback_ = NULL;
+    PyObject *msg = NULL;
+    const char *_msg_ = NULL, *_type_ = "error";
+    char *result = NULL;
+
+    PyErr_Fetch(&_exc_type_, &_exc_value_, &_exc_traceback_);
+    if (_exc_type_ != PyExc_MemoryError) {
+        if (_exc_type_) {
+            _type_ = ((PyTypeObject *)_exc_type_)->tp_name;
+        }
+        if (
+            _exc_value_ &&
+            (msg = PyObject_Str(_exc_value_)) &&
+            (_msg_ = PyUnicode_AsUTF8(msg)) &&
+            _msg_[0]
+        ) {
+            result = sqlite3_mprintf("%s: %s", _type_, _msg_);
+        }
+        else {
+            result = sqlite3_mprintf("%s", _type_);
+        }
+        Py_XDECREF(msg);
+        PyErr_Clear();
+    }
+    Py_XDECREF(_exc_type_);
+    Py_XDECREF(_exc_value_);
+    Py_XDECREF(_exc_traceback_);
+    return result;
+}
+
+
+static void
+__function_error__(sqlite3_context *ctx)
+{
+    char *msg = NULL;
+
+    if ((msg = __error_string__())) {
+        sqlite3_result_error(ctx, msg, -1);
+        sqlite3_free(msg);
+    }
+    else {
+        sqlite3_result_error_nomem(ctx);
+    }
+}
+
+
+/* does not need the GIL */
+static void
+__context_result_cvalue__(
+    sqlite3_context *ctx, Value *value, sqlite3_destructor_type destructor
+)
+{
+    switch (value->type) {
+        case SQLITE_INTEGER:
+            sqlite3_result_int64(ctx, value->value.l);
+            break;
+        case SQLITE_FLOAT:
+            sqlite3_result_double(ctx, value->value.d);
+            break;
+        case SQLITE_TEXT:
+            sqlite3_result_text64(
+                ctx, value->value.s, value->size, destructor, SQLITE_UTF8
+            );
+            break;
+        case SQLITE_BLOB:
+            sqlite3_result_blob64(ctx, value->value.s, value->size, destructor);
+            break;
+        default:
+            sqlite3_result_null(ctx);
+            break;
+    }
+}
+
+
+static void
+__function_result__(sqlite3_context *ctx, PyObject *result)
+{
+    Value value;
+
+    if (!result || __value_from_object__(&value, result)) {
+        __function_error__(ctx);
+        return;
+    }
+    __context_result_cvalue__(ctx, &value, SQLITE_TRANSIENT);
+}
+
+
+/* sqlite3_create_function_v2.xDestroy */
+static void
+__function_destroy__(void *callable)
+{
+    PyGILState_STATE state;
+
+    if (!_Py_IsFinalizing()) {
+        state = PyGILState_Ensure();
+        Py_DECREF((PyObject *)callable);
+        PyGILState_Release(state);
+    }
+}
+
+
+/* sqlite3_create_function_v2.xFunc */
+static void
+__function_call__(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    PyGILState_STATE state = PyGILState_Ensure();
+    PyObject *args = NULL, *result = NULL;
+
+    if ((args = __function_args__(argc, argv))) {
+        result = PyObject_Call(sqlite3_user_data(ctx), args, NULL);
+        Py_DECREF(args);
+    }
+    __function_result__(ctx, result);
+    Py_XDECREF(result);
+    PyGILState_Release(state);
+}
+
+
+/* the aggregate instance lives in the aggregate context, it is created by the
+   first call and released by xFinal */
+static PyObject **
+__aggregate_instance__(sqlite3_context *ctx, int create)
+{
+    PyObject **instance = NULL;
+
+    if (
+        !(
+            instance = sqlite3_aggregate_context(
+                ctx, (create) ? sizeof(PyObject *) : 0
+            )
+        )
+    ) {
+        if (create) {
+            PyErr_NoMemory();
+        }
+        return NULL;
+    }
+    if (
+        !*instance &&
+        !(*instance = PyObject_CallNoArgs(sqlite3_user_data(ctx)))
+    ) {
+        return NULL;
+    }
+    return instance;
+}
+
+
+static void
+__aggregate_method__(
+    sqlite3_context *ctx,
+    const char *name,
+    int argc,
+    sqlite3_value **argv
+)
+{
+    PyGILState_STATE state = PyGILState_Ensure();
+    PyObject **instance = NULL, *method = NULL, *args = NULL, *res = NULL;
+
+    if (
+        (instance = __aggregate_instance__(ctx, 1)) &&
+        (method = PyObject_GetAttrString(*instance, name)) &&
+        (args = __function_args__(argc, argv)) &&
+        (res = PyObject_Call(method, args, NULL))
+    ) {
+        Py_DECREF(res);
+    }
+    else {
+        __function_error__(ctx);
+    }
+    Py_XDECREF(args);
+    Py_XDECREF(method);
+    PyGILState_Release(state);
+}
+
+
+/* sqlite3_create_function_v2.xStep */
+static void
+__aggregate_step__(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    __aggregate_method__(ctx, "step", argc, argv);
+}
+
+
+/* sqlite3_create_window_function.xInverse */
+static void
+__aggregate_inverse__(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    __aggregate_method__(ctx, "inverse", argc, argv);
+}
+
+
+static void
+__aggregate_result__(sqlite3_context *ctx, const char *name, int final)
+{
+    PyGILState_STATE state = PyGILState_Ensure();
+    PyObject **instance = NULL, *result = NULL;
+
+    // no row at all, the instance still has to give its (empty) result
+    if ((instance = __aggregate_instance__(ctx, 1))) {
+        result = PyObject_CallMethod(*instance, name, NULL);
+    }
+    __function_result__(ctx, result);
+    Py_XDECREF(result);
+    if (final && instance) {
+        Py_CLEAR(*instance);
+    }
+    PyGILState_Release(state);
+}
+
+
+/* sqlite3_create_function_v2.xFinal */
+static void
+__aggregate_final__(sqlite3_context *ctx)
+{
+    __aggregate_result__(ctx, "finalize", 1);
+}
+
+
+/* sqlite3_create_window_function.xValue */
+static void
+__aggregate_value__(sqlite3_context *ctx)
+{
+    __aggregate_result__(ctx, "value", 0);
+}
+
+
+/* sqlite has no reference on a native function's capsule (its context is
+   the user data), it is kept in Database.natives (keyed on the lowered name
+   and narg) until the function is removed or replaced */
+static int
+__function_keep__(
+    Database *self, const char *name, int narg, PyObject *capsule
+)
+{
+    PyObject *_name_ = NULL, *lower = NULL, *key = NULL;
+    int res = -1;
+
+    if (!capsule && !self->natives) {
+        return 0;
+    }
+    if (!self->natives && !(self->natives = PyDict_New())) {
+        return -1;
+    }
+    if (
+        (_name_ = PyUnicode_FromString(name)) &&
+        (lower = PyObject_CallMethod(_name_, "lower", NULL)) &&
+        (key = Py_BuildValue("(Oi)", lower, narg))
+    ) {
+        if (capsule) {
+            res = PyDict_SetItem(self->natives, key, capsule);
+        }
+        else if ((res = PyDict_Contains(self->natives, key)) > 0) {
+            res = PyDict_DelItem(self->natives, key);
+        }
+    }
+    Py_XDECREF(key);
+    Py_XDECREF(lower);
+    Py_XDECREF(_name_);
+    return (res < 0) ? -1 : 0;
+}
+
+
+static int
+__function_create__(
+    Database *self,
+    const char *name,
+    int narg,
+    PyObject *callable,
+    int kind,
+    int flags
+)
+{
+    xFunc func = NULL;
+    void *context = NULL;
+    int rc = SQLITE_OK;
+
+    flags |= SQLITE_UTF8;
+    if (callable == Py_None) {
+        // removes the function
+        rc = (kind == __FUNCTION_WINDOW__) ?
+            sqlite3_create_window_function(
+                self->db, name, narg, flags, NULL, NULL, NULL, NULL, NULL, NULL
+            ) :
+            sqlite3_create_function_v2(
+                self->db, name, narg, flags, NULL, NULL, NULL, NULL, NULL
+            );
+    }
+    else if (PyCapsule_CheckExact(callable)) {
+        // a native xFunc, called without any python involved
+        if (kind != __FUNCTION_SCALAR__) {
+            PyErr_SetString(
+                PyExc_TypeError, "only scalar functions can be native"
+            );
+            return -1;
+        }
+        if (
+            !(
+                func = (xFunc)PyCapsule_GetPointer(
+                    callable, __FUNCTION_CAPSULE__
+                )
+            ) ||
+            (!(context = PyCapsule_GetContext(callable)) && PyErr_Occurred())
+        ) {
+            return -1;
+        }
+        rc = sqlite3_create_function_v2(
+            self->db, name, narg, flags, context, func, NULL, NULL, NULL
+        );
+    }
+    else if (!PyCallable_Check(callable)) {
+        PyErr_SetString(PyExc_TypeError, "function must be callable");
+        return -1;
+    }
+    else {
+        // on failure sqlite calls xDestroy, the reference is always consumed
+        Py_INCREF(callable);
+        switch (kind) {
+            case __FUNCTION_SCALAR__:
+                rc = sqlite3_create_function_v2(
+                    self->db,
+                    name,
+                    narg,
+                    flags,
+                    callable,
+                    __function_call__,
+                    NULL,
+                    NULL,
+                    __function_destroy__
+                );
+                break;
+            case __FUNCTION_AGGREGATE__:
+                rc = sqlite3_create_function_v2(
+                    self->db,
+                    name,
+                    narg,
+                    flags,
+                    callable,
+                    NULL,
+                    __aggregate_step__,
+                    __aggregate_final__,
+                    __function_destroy__
+                );
+                break;
+            default:
+                rc = sqlite3_create_window_function(
+                    self->db,
+                    name,
+                    narg,
+                    flags,
+                    callable,
+                    __aggregate_step__,
+                    __aggregate_final__,
+                    __aggregate_value__,
+                    __aggregate_inverse__,
+                    __function_destroy__
+                );
+                break;
+        }
+    }
+    if (rc != SQLITE_OK) {
+        _PyErr_FromDatabase(self);
+        return -1;
+    }
+    return __function_keep__(
+        self, name, narg, PyCapsule_CheckExact(callable) ? callable : NULL
+    );
+}
+
+
+/* --------------------------------------------------------------------------
+   VirtualTable
+   -------------------------------------------------------------------------- */
+
+/* the "mood" module exposes python data as (temp) tables:
+   - a mapping of column sources (see ColumnSource): scanned without the GIL,
+     the rowid is the row index, rowid seeks/ranges and comparisons on numeric
+     columns are pushed down (sqlite still double-checks),
+   - an iterable of rows: every scan iterates it again, with the GIL.
+   sources are kept in Database.tables (keyed on the table name) as long as
+   the table exists */
+
+typedef struct {
+    sqlite3_vtab base;
+    Database *db;
+    PyObject *name;
+    PyObject *source; // iterable
+    ColumnSource *columns; // mapping
+    int count;
+    Py_ssize_t length;
+} VTable;
+
+
+typedef struct {
+    int column;
+    int op;
+    Value value;
+} VFilter;
+
+
+typedef struct {
+    sqlite3_vtab_cursor base;
+    Py_ssize_t row;
+    Py_ssize_t stop;
+    VFilter *filters;
+    int count;
+    PyObject *iterator;
+    PyObject *current;
+} VCursor;
+
+
+static void
+__vtable_error__(sqlite3_vtab *vtab)
+{
+    sqlite3_free(vtab->zErrMsg);
+    vtab->zErrMsg = __error_string__();
+}
+
+
+static void
+__vtable_free__(VTable *self)
+{
+    int i;
+
+    if (self->columns) {
+        for (i = 0; i < self->count; ++i) {
+            __column_source_release__(&self->columns[i]);
+        }
+        PyMem_Free(self->columns);
+    }
+    Py_CLEAR(self->source);
+    Py_CLEAR(self->name);
+    PyMem_Free(self);
+}
+
+
+static const char *
+__vtable_decltype__(int type)
+{
+    switch (type) {
+        case SQLITE_INTEGER:
+            return " INTEGER";
+        case SQLITE_FLOAT:
+            return " REAL";
+        case SQLITE_TEXT:
+            return " TEXT";
+        case SQLITE_BLOB:
+            return " BLOB";
+        default:
+            return "";
+    }
+}
+
+
+/* types receives the sqlite type of every column (None for an iterable) */
+static int
+__vtable_init__(VTable *self, PyObject *spec, PyObject *types)
+{
+    PyObject *source = PyTuple_GET_ITEM(spec, 0), *key = NULL, *value = NULL;
+    Py_ssize_t pos = 0, i;
+    int k = 0;
+
+    if (!PyDict_Check(source)) {
+        self->source = Py_NewRef(source);
+        for (i = 0; i < PyList_GET_SIZE(types); ++i) {
+            PyList_SET_ITEM(types, i, Py_NewRef(Py_None));
+        }
+        return 0;
+    }
+    self->count = (int)PyDict_GET_SIZE(source);
+    self->length = -1;
+    if (!(self->columns = PyMem_Calloc(self->count, sizeof(ColumnSource)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    while (PyDict_Next(source, &pos, &key, &value)) {
+        if (__column_source_init__(&self->columns[k], value)) {
+            self->count = k;
+            return -1;
+        }
+        if (self->columns[k].length >= 0) {
+            if (
+                (self->length >= 0) &&
+                (self->columns[k].length != self->length)
+            ) {
+                self->count = k + 1;
+                PyErr_SetString(
+                    PyExc_ValueError, "columns must have the same length"
+                );
+                return -1;
+            }
+            self->length = self->columns[k].length;
+        }
+        if (!(value = PyLong_FromLong(self->columns[k].type))) {
+            self->count = k + 1;
+            return -1;
+        }
+        PyList_SET_ITEM(types, k++, value);
+    }
+    self->length = Py_MAX(self->length, 0);
+    return 0;
+}
+
+
+/* sqlite3_module.xCreate/xConnect */
+static int
+__vtable_connect__(
+    sqlite3 *db,
+    void *aux,
+    int argc,
+    const char *const *argv,
+    sqlite3_vtab **vtab,
+    char **err
+)
+{
+    PyGILState_STATE state = PyGILState_Ensure();
+    Database *self = aux;
+    VTable *table = NULL;
+    PyObject *spec = NULL, *names = NULL, *types = NULL, *name = NULL;
+    char *schema = NULL, *tmp = NULL;
+    Py_ssize_t i, size;
+    int rc = SQLITE_ERROR;
+
+    if (
+        !self->tables ||
+        !(spec = PyDict_GetItemString(self->tables, argv[2]))
+    ) {
+        *err = sqlite3_mprintf("no source for table '%s'", argv[2]);
+        goto exit;
+    }
+    names = PyTuple_GET_ITEM(spec, 1);
+    size = PyTuple_GET_SIZE(names);
+    if (
+        !(table = PyMem_Calloc(1, sizeof(VTable))) ||
+        !(table->name = PyUnicode_FromString(argv[2])) ||
+        !(types = PyList_New(size)) ||
+        __vtable_init__(table, spec, types)
+    ) {
+        if (!PyErr_Occurred()) {
+            PyErr_NoMemory();
+        }
+        goto fail;
+    }
+    schema = sqlite3_mprintf("CREATE TABLE x(");
+    for (i = 0; schema && (i < size); ++i) {
+        name = PyTuple_GET_ITEM(names, i);
+        tmp = schema;
+        schema = sqlite3_mprintf(
+            "%s%s\"%w\"%s",
+            tmp,
+            (i) ? ", " : "",
+            PyUnicode_AsUTF8(name),
+            __vtable_decltype__(
+                (PyList_GET_ITEM(types, i) == Py_None) ?
+                0 : PyLong_AsLong(PyList_GET_ITEM(types, i))
+            )
+        );
+        sqlite3_free(tmp);
+    }
+    if (schema) {
+        tmp = schema;
+        schema = sqlite3_mprintf("%s)", tmp);
+        sqlite3_free(tmp);
+    }
+    if (!schema) {
+        rc = SQLITE_NOMEM;
+        goto exit;
+    }
+    if ((rc = sqlite3_declare_vtab(db, schema)) != SQLITE_OK) {
+        *err = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+        goto exit;
+    }
+    table->db = self;
+    *vtab = &table->base;
+    table = NULL;
+    goto exit;
+fail:
+    *err = __error_string__();
+    rc = (*err) ? SQLITE_ERROR : SQLITE_NOMEM;
+exit:
+    sqlite3_free(schema);
+    if (table) {
+        __vtable_free__(table);
+    }
+    Py_XDECREF(types);
+    PyGILState_Release(state);
+    return rc;
+}
+
+
+/* sqlite3_module.xDisconnect */
+static int
+__vtable_disconnect__(sqlite3_vtab *vtab)
+{
+    PyGILState_STATE state;
+
+    if (!_Py_IsFinalizing()) {
+        state = PyGILState_Ensure();
+        __vtable_free__((VTable *)vtab);
+        PyGILState_Release(state);
+    }
+    return SQLITE_OK;
+}
+
+
+/* sqlite3_module.xDestroy */
+static int
+__vtable_destroy__(sqlite3_vtab *vtab)
+{
+    VTable *self = (VTable *)vtab;
+    PyGILState_STATE state;
+
+    if (!_Py_IsFinalizing()) {
+        state = PyGILState_Ensure();
+        // dropped, the source is not needed anymore
+        if (
+            self->db->tables &&
+            PyDict_DelItem(self->db->tables, self->name)
+        ) {
+            PyErr_Clear();
+        }
+        __vtable_free__(self);
+        PyGILState_Release(state);
+    }
+    return SQLITE_OK;
+}
+
+
+static int
+__vtable_op__(int op)
+{
+    switch (op) {
+        case SQLITE_INDEX_CONSTRAINT_EQ:
+            return '=';
+        case SQLITE_INDEX_CONSTRAINT_GT:
+            return '>';
+        case SQLITE_INDEX_CONSTRAINT_GE:
+            return 'g';
+        case SQLITE_INDEX_CONSTRAINT_LT:
+            return '<';
+        case SQLITE_INDEX_CONSTRAINT_LE:
+            return 'l';
+        default:
+            return 0;
+    }
+}
+
+
+/* sqlite3_module.xBestIndex */
+static int
+__vtable_best_index__(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+    VTable *self = (VTable *)vtab;
+    const struct sqlite3_index_constraint *constraint = NULL;
+    char *plan = NULL, *tmp = NULL;
+    double rows = 0.0;
+    int i, op, type, count = 0, unique = 0, range = 0;
+
+    if (self->source) {
+        // an iterable can only be scanned (and it is expensive)
+        info->estimatedCost = 1e9;
+        info->estimatedRows = 1000000;
+        return SQLITE_OK;
+    }
+    rows = (double)self->length;
+    for (i = 0; i < info->nConstraint; ++i) {
+        constraint = &info->aConstraint[i];
+        if (!constraint->usable || !(op = __vtable_op__(constraint->op))) {
+            continue;
+        }
+        if (constraint->iColumn >= 0) {
+            type = self->columns[constraint->iColumn].type;
+            if ((type != SQLITE_INTEGER) && (type != SQLITE_FLOAT)) {
+                continue;
+            }
+        }
+        tmp = plan;
+        plan = sqlite3_mprintf(
+            "%s%d%c,", (tmp) ? tmp : "", constraint->iColumn, op
+        );
+        sqlite3_free(tmp);
+        if (!plan) {
+            return SQLITE_NOMEM;
+        }
+        info->aConstraintUsage[i].argvIndex = ++count;
+        if (constraint->iColumn < 0) {
+            if (op == '=') {
+                unique = 1;
+            }
+            else {
+                range++;
+            }
+        }
+        else {
+            rows *= (op == '=') ? 0.1 : 0.5;
+        }
+    }
+    if (unique) {
+        info->estimatedCost = 1.0;
+        info->estimatedRows = 1;
+        info->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+    }
+    else {
+        info->estimatedCost = (range) ? (self->length / (2.0 * range)) : self->length;
+        info->estimatedRows = (sqlite3_int64)(rows / (1 << range)) + 1;
+    }
+    info->idxNum = count;
+    info->idxStr = plan;
+    info->needToFreeIdxStr = 1;
+    // rows come out in rowid order
+    if (
+        (info->nOrderBy == 1) &&
+        (info->aOrderBy[0].iColumn < 0) &&
+        !info->aOrderBy[0].desc
+    ) {
+        info->orderByConsumed = 1;
+    }
+    return SQLITE_OK;
+}
+
+
+/* sqlite3_module.xOpen */
+static int
+__vtable_open__(sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor)
+{
+    VCursor *self = NULL;
+
+    if (!(self = sqlite3_malloc(sizeof(VCursor)))) {
+        return SQLITE_NOMEM;
+    }
+    memset(self, 0, sizeof(VCursor));
+    *cursor = &self->base;
+    return SQLITE_OK;
+}
+
+
+/* sqlite3_module.xClose */
+static int
+__vtable_close__(sqlite3_vtab_cursor *cursor)
+{
+    VCursor *self = (VCursor *)cursor;
+    PyGILState_STATE state;
+
+    if ((self->iterator || self->current) && !_Py_IsFinalizing()) {
+        state = PyGILState_Ensure();
+        Py_CLEAR(self->current);
+        Py_CLEAR(self->iterator);
+        PyGILState_Release(state);
+    }
+    sqlite3_free(self->filters);
+    sqlite3_free(self);
+    return SQLITE_OK;
+}
+
+
+/* a double can't hold every int64, an integer and a real are compared
+   exactly (like sqlite does) */
+static int
+__int_float_compare__(long long i, double r)
+{
+    long long y = 0;
+    double s = 0.0;
+
+    if (r != r) {
+        return 1; // NaN
+    }
+    if (r < -9223372036854775808.0) {
+        return 1;
+    }
+    if (r >= 9223372036854775808.0) {
+        return -1;
+    }
+    y = (long long)r;
+    if (i != y) {
+        return (i > y) - (i < y);
+    }
+    // same integral part, (double)i is exact here
+    s = (double)i;
+    return (s > r) - (s < r);
+}
+
+
+/* numbers (SQLITE_INTEGER or SQLITE_FLOAT) only */
+static int
+__value_number_compare__(Value *x, Value *y)
+{
+    if (x->type == SQLITE_INTEGER) {
+        if (y->type == SQLITE_INTEGER) {
+            return (x->value.l > y->value.l) - (x->value.l < y->value.l);
+        }
+        return __int_float_compare__(x->value.l, y->value.d);
+    }
+    if (y->type == SQLITE_INTEGER) {
+        return -__int_float_compare__(y->value.l, x->value.d);
+    }
+    return (x->value.d > y->value.d) - (x->value.d < y->value.d);
+}
+
+
+static int
+__vfilter_match__(VFilter *filter, Value *value)
+{
+    int cmp = 0;
+
+    if (value->type == SQLITE_NULL) {
+        return 0;
+    }
+    cmp = __value_number_compare__(value, &filter->value);
+    switch (filter->op) {
+        case '=':
+            return cmp == 0;
+        case '>':
+            return cmp > 0;
+        case 'g':
+            return cmp >= 0;
+        case '<':
+            return cmp < 0;
+        default:
+            return cmp <= 0;
+    }
+}
+
+
+/* does not need the GIL */
+static void
+__vcursor_seek__(VCursor *self, VTable *table)
+{
+    Value value;
+    int i;
+
+    for (; self->row < self->stop; self->row++) {
+        for (i = 0; i < self->count; ++i) {
+            if (
+                __column_source_value__(
+                    &table->columns[self->filters[i].column], self->row, &value
+                ) ||
+                !__vfilter_match__(&self->filters[i], &value)
+            ) {
+                break;
+            }
+        }
+        if (i == self->count) {
+            break;
+        }
+    }
+}
+
+
+static void
+__vcursor_bound__(VCursor *self, int op, sqlite3_value *arg)
+{
+    double value = sqlite3_value_double(arg), lo = 0.0, hi = (double)self->stop;
+
+    switch (op) {
+        case '=':
+            if (value != floor(value)) {
+                hi = lo = 0.0;
+            }
+            else {
+                lo = value;
+                hi = value + 1;
+            }
+            break;
+        case '>':
+            lo = floor(value) + 1;
+            break;
+        case 'g':
+            lo = ceil(value);
+            break;
+        case '<':
+            hi = ceil(value);
+            break;
+        default:
+            hi = floor(value) + 1;
+            break;
+    }
+    if (lo > (double)self->row) {
+        self->row = (lo >= (double)self->stop) ? self->stop : (Py_ssize_t)lo;
+    }
+    if (hi < (double)self->stop) {
+        self->stop = (hi <= 0.0) ? 0 : (Py_ssize_t)hi;
+    }
+}
+
+
+static int
+__vcursor_next__(VCursor *self, VTable *table)
+{
+    PyGILState_STATE state;
+    PyObject *item = NULL;
+    int rc = SQLITE_OK;
+
+    if (!table->source) {
+        self->row++;
+        __vcursor_seek__(self, table);
+        return SQLITE_OK;
+    }
+    state = PyGILState_Ensure();
+    Py_CLEAR(self->current);
+    if ((item = PyIter_Next(self->iterator))) {
+        if ((self->current = PySequence_Fast(item, "rows must be sequences"))) {
+            self->row++;
+        }
+        Py_DECREF(item);
+    }
+    else if (!PyErr_Occurred()) {
+        self->stop = self->row; // exhausted
+    }
+    if (PyErr_Occurred()) {
+        __vtable_error__(&table->base);
+        rc = SQLITE_ERROR;
+    }
+    PyGILState_Release(state);
+    return rc;
+}
+
+
+/* sqlite3_module.xFilter */
+static int
+__vtable_filter__(
+    sqlite3_vtab_cursor *cursor,
+    int count,
+    const char *plan,
+    int argc,
+    sqlite3_value **argv
+)
+{
+    VCursor *self = (VCursor *)cursor;
+    VTable *table = (VTable *)cursor->pVtab;
+    PyGILState_STATE state;
+    int i, column, type, n = 0, rc = SQLITE_OK;
+    char op;
+
+    if (table->source) {
+        state = PyGILState_Ensure();
+        Py_CLEAR(self->current);
+        if ((self->iterator = PyObject_GetIter(table->source))) {
+            self->row = -1;
+            self->stop = PY_SSIZE_T_MAX;
+        }
+        else {
+            __vtable_error__(&table->base);
+            rc = SQLITE_ERROR;
+        }
+        PyGILState_Release(state);
+        return (rc == SQLITE_OK) ? __vcursor_next__(self, table) : rc;
+    }
+    self->row = 0;
+    self->stop = table->length;
+    self->count = 0;
+    sqlite3_free(self->filters);
+    if (!(self->filters = sqlite3_malloc(Py_MAX(argc, 1) * sizeof(VFilter)))) {
+        return SQLITE_NOMEM;
+    }
+    for (i = 0; plan && (i < argc); ++i) {
+        if (sscanf(plan, "%d%c,%n", &column, &op, &n) != 2) {
+            break;
+        }
+        plan += n;
+        // only numeric comparisons are exact, sqlite checks the rest
+        type = sqlite3_value_type(argv[i]);
+        if ((type != SQLITE_INTEGER) && (type != SQLITE_FLOAT)) {
+            continue;
+        }
+        if (column < 0) {
+            __vcursor_bound__(self, op, argv[i]);
+        }
+        else {
+            self->filters[self->count].column = column;
+            self->filters[self->count].op = op;
+            self->filters[self->count].value.type = type;
+            if (type == SQLITE_INTEGER) {
+                self->filters[self->count].value.value.l = sqlite3_value_int64(argv[i]);
+            }
+            else {
+                self->filters[self->count].value.value.d = sqlite3_value_double(argv[i]);
+            }
+            self->count++;
+        }
+    }
+    __vcursor_seek__(self, table);
+    return SQLITE_OK;
+}
+
+
+/* sqlite3_module.xNext */
+static int
+__vtable_next__(sqlite3_vtab_cursor *cursor)
+{
+    return __vcursor_next__((VCursor *)cursor, (VTable *)cursor->pVtab);
+}
+
+
+/* sqlite3_module.xEof */
+static int
+__vtable_eof__(sqlite3_vtab_cursor *cursor)
+{
+    VCursor *self = (VCursor *)cursor;
+
+    return self->row >= self->stop;
+}
+
+
+/* sqlite3_module.xColumn */
+static int
+__vtable_column__(sqlite3_vtab_cursor *cursor, sqlite3_context *ctx, int i)
+{
+    VCursor *self = (VCursor *)cursor;
+    VTable *table = (VTable *)cursor->pVtab;
+    PyGILState_STATE state;
+    Value value;
+    int rc = SQLITE_OK;
+
+    if (!table->source) {
+        if (
+            (
+                rc = __column_source_value__(
+                    &table->columns[i], self->row, &value
+                )
+            ) != SQLITE_OK
+        ) {
+            sqlite3_result_error(ctx, "invalid offsets", -1);
+            return rc;
+        }
+        // the buffers outlive the statement
+        __context_result_cvalue__(ctx, &value, SQLITE_STATIC);
+        return SQLITE_OK;
+    }
+    state = PyGILState_Ensure();
+    if (i >= PySequence_Fast_GET_SIZE(self->current)) {
+        sqlite3_result_null(ctx);
+    }
+    else if (
+        __value_from_object__(
+            &value, PySequence_Fast_GET_ITEM(self->current, i)
+        )
+    ) {
+        __function_error__(ctx);
+        rc = SQLITE_ERROR;
+    }
+    else {
+        __context_result_cvalue__(ctx, &value, SQLITE_TRANSIENT);
+    }
+    PyGILState_Release(state);
+    return rc;
+}
+
+
+/* sqlite3_module.xRowid */
+static int
+__vtable_rowid__(sqlite3_vtab_cursor *cursor, sqlite3_int64 *rowid)
+{
+    *rowid = ((VCursor *)cursor)->row;
+    return SQLITE_OK;
+}
+
+
+static sqlite3_module __vtable_module__ = {
+    .iVersion = 0,
+    .xCreate = __vtable_connect__,
+    .xConnect = __vtable_connect__,
+    .xBestIndex = __vtable_best_index__,
+    .xDisconnect = __vtable_disconnect__,
+    .xDestroy = __vtable_destroy__,
+    .xOpen = __vtable_open__,
+    .xClose = __vtable_close__,
+    .xFilter = __vtable_filter__,
+    .xNext = __vtable_next__,
+    .xEof = __vtable_eof__,
+    .xColumn = __vtable_column__,
+    .xRowid = __vtable_rowid__,
+};
+
+
+static int
+__vtable_create__(
+    Database *self, PyObject *name, PyObject *source, PyObject *columns
+)
+{
+    PyObject *names = NULL, *spec = NULL;
+    const char *_name_ = NULL;
+    char *sql = NULL;
+    Py_ssize_t i, size;
+    int rc = SQLITE_OK, res = -1;
+
+    if (!(_name_ = PyUnicode_AsUTF8(name))) {
+        return -1;
+    }
+    if (!self->tables) {
+        if (
+            (
+                rc = sqlite3_create_module_v2(
+                    self->db, "mood", &__vtable_module__, self, NULL
+                )
+            ) != SQLITE_OK
+        ) {
+            _PyErr_FromDatabase(self);
+            return -1;
+        }
+        if (!(self->tables = PyDict_New())) {
+            return -1;
+        }
+    }
+    if (source == Py_None) {
+        sql = sqlite3_mprintf("DROP TABLE IF EXISTS temp.\"%w\"", _name_);
+    }
+    else {
+        if ((res = PyDict_Contains(self->tables, name))) {
+            if (res > 0) {
+                PyErr_Format(
+                    PyExc_ValueError, "table '%s' already exists", _name_
+                );
+            }
+            return -1;
+        }
+        res = -1;
+        if (PyDict_Check(source)) {
+            if (columns) {
+                PyErr_SetString(
+                    PyExc_TypeError, "columns are the keys of the mapping"
+                );
+                return -1;
+            }
+            names = PyDict_Keys(source);
+        }
+        else if (!columns) {
+            PyErr_SetString(
+                PyExc_TypeError, "columns are required for an iterable"
+            );
+            return -1;
+        }
+        else {
+            names = PySequence_List(columns);
+        }
+        if (!names) {
+            return -1;
+        }
+        if (!(size = PyList_GET_SIZE(names))) {
+            PyErr_SetString(PyExc_ValueError, "a table needs columns");
+            goto exit;
+        }
+        for (i = 0; i < size; ++i) {
+            if (!PyUnicode_Check(PyList_GET_ITEM(names, i))) {
+                PyErr_SetString(PyExc_TypeError, "column names must be str");
+                goto exit;
+            }
+        }
+        if (
+            !(spec = Py_BuildValue("(ON)", source, PyList_AsTuple(names))) ||
+            PyDict_SetItem(self->tables, name, spec)
+        ) {
+            goto exit;
+        }
+        sql = sqlite3_mprintf(
+            "CREATE VIRTUAL TABLE temp.\"%w\" USING mood", _name_
+        );
+    }
+    if (!sql) {
+        PyErr_NoMemory();
+    }
+    else if ((rc = sqlite3_exec(self->db, sql, NULL, NULL, NULL)) != SQLITE_OK) {
+        _PyErr_FromDatabase(self);
+    }
+    else {
+        res = 0;
+    }
+    if (res && spec && PyDict_DelItem(self->tables, name)) {
+        PyErr_Clear();
+    }
+exit:
+    sqlite3_free(sql);
+    Py_XDECREF(spec);
+    Py_XDECREF(names);
+    return res;
+}
+
+
+/* --------------------------------------------------------------------------
+   Transaction
+   -------------------------------------------------------------------------- */
+
+/* the outermost transaction is a BEGIN/COMMIT, nested ones (or any inside a
+   transaction that was started by hand) are savepoints */
+
+static PyObject *
+__transaction_new__(Database *db, int mode, Py_ssize_t size, double interval)
+{
+    Transaction *self = NULL;
+
+    if ((self = PyObject_GC_New(Transaction, &Transaction_Type))) {
+        self->db = (Database *)Py_NewRef(db);
+        self->mode = mode;
+        self->depth = 0;
+        self->savepoint = 0;
+        self->size = size;
+        self->interval = (_PyTime_t)(interval * 1e9);
+        PyObject_GC_Track(self);
+    }
+    return (PyObject *)self;
+}
+
+
+static int
+__transaction_begin__(Transaction *self)
+{
+    Database *db = self->db;
+
+    if (self->depth) {
+        PyErr_SetString(PyExc_RuntimeError, "transaction already started");
+        return -1;
+    }
+    if ((self->savepoint = (db->depth || !__sqlite_db_autocommit__(db->db)))) {
+        if (__db_savepoint__(db, "SAVEPOINT", db->depth)) {
+            return -1;
+        }
+    }
+    else if (__db_tx__(db, self->mode)) {
+        return -1;
+    }
+    else if (self->size || self->interval) {
+        db->group_mode = self->mode;
+        db->group_size = self->size;
+        db->group_interval = self->interval;
+        db->group_count = 0;
+        db->group_start = _PyTime_GetPerfCounter();
+    }
+    self->depth = ++db->depth;
+    return 0;
+}
+
+
+static int
+__transaction_end__(Transaction *self, int failed)
+{
+    Database *db = self->db;
+    int depth = self->depth;
+
+    if (!depth) {
+        PyErr_SetString(PyExc_RuntimeError, "transaction not started");
+        return -1;
+    }
+    if (depth != db->depth) {
+        PyErr_SetString(PyExc_RuntimeError, "transactions must end in order");
+        return -1;
+    }
+    self->depth = 0;
+    db->depth--;
+    if (self->savepoint) {
+        if (failed) {
+            if (
+                __db_savepoint__(db, "ROLLBACK TO", db->depth) ||
+                __db_savepoint__(db, "RELEASE", db->depth)
+            ) {
+                return -1;
+            }
+            return 0;
+        }
+        return __db_savepoint__(db, "RELEASE", db->depth);
+    }
+    db->group_size = 0;
+    db->group_interval = 0;
+    if (__sqlite_db_autocommit__(db->db)) {
+        return 0; // ended by hand (or rolled back by sqlite)
+    }
+    if (failed) {
+        return __db_tx__(db, __TX_ROLLBACK__);
+    }
+    return __db_tx_end__(db, 0);
+}
+
+
+/* an abandoned (entered but never exited) transaction is rolled back, along
+   with anything still nested in it */
+static int
+__transaction_abandon__(Transaction *self)
+{
+    Database *db = self->db;
+
+    if (!self->depth || !db || !db->db || (self->depth > db->depth)) {
+        self->depth = 0;
+        return 0;
+    }
+    if (__db_check_thread__(db)) {
+        return -1;
+    }
+    db->depth = self->depth;
+    return __transaction_end__(self, 1);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Transaction_Type.tp_finalize */
+static void
+Transaction_tp_finalize(Transaction *self)
+{
+    PyObject *_exc_type_ = NULL, *_exc_value_ = NULL, *_exc_traceback_ = NULL;
+
+    PyErr_Fetch(&_exc_type_, &_exc_value_, &_exc_traceback_);
+    if (__transaction_abandon__(self)) {
+        PyErr_WriteUnraisable((PyObject *)self);
+    }
+    PyErr_Restore(_exc_type_, _exc_value_, _exc_traceback_);
+}
+
+
+/* Transaction_Type.tp_traverse */
+static int
+Transaction_tp_traverse(Transaction *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->db);
+    return 0;
+}
+
+
+/* Transaction_Type.tp_clear */
+static int
+Transaction_tp_clear(Transaction *self)
+{
+    Py_CLEAR(self->db);
+    return 0;
+}
+
+
+/* Transaction_Type.tp_dealloc */
+static void
+Transaction_tp_dealloc(Transaction *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    Transaction_tp_clear(self);
+    PyObject_GC_Del(self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Transaction.__enter__() */
+static PyObject *
+Transaction_enter(Transaction *self)
+{
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+    if (__transaction_begin__(self)) {
+        return NULL;
+    }
+    return Py_NewRef(self);
+}
+
+
+/* Transaction.__exit__() */
+static PyObject *
+Transaction_exit(Transaction *self, PyObject *args)
+{
+    PyObject *exc_type = NULL, *exc_value = NULL, *exc_traceback = NULL;
+
+    if (__db_check_thread__(self->db)) {
+        return NULL;
+    }
+
+    if (
+        !PyArg_UnpackTuple(
+            args, "__exit__", 3, 3, &exc_type, &exc_value, &exc_traceback
+        ) ||
+        __transaction_end__(self, (exc_type != Py_None))
+    ) {
+        return NULL;
+    }
+    Py_RETURN_FALSE;
+}
+
+
+/* Transaction_Type.tp_methods */
+static PyMethodDef Transaction_tp_methods[] = {
+    {"__enter__", (PyCFunction)Transaction_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)Transaction_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Transaction.active */
+static PyObject *
+Transaction_active_getter(Transaction *self, void *closure)
+{
+    return PyBool_FromLong(self->depth);
+}
+
+
+/* Transaction_Type.tp_getsets */
+static PyGetSetDef Transaction_tp_getset[] = {
+    {"active", (getter)Transaction_active_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {NULL}
+};
+
+
+/* Transaction_Type --------------------------------------------------------- */
+
+static PyTypeObject Transaction_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.sqlite.Transaction",
+    .tp_basicsize = sizeof(Transaction),
+    .tp_dealloc = (destructor)Transaction_tp_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
+    .tp_traverse = (traverseproc)Transaction_tp_traverse,
+    .tp_clear = (inquiry)Transaction_tp_clear,
+    .tp_methods = Transaction_tp_methods,
+    .tp_getset = Transaction_tp_getset,
+    .tp_finalize = (destructor)Transaction_tp_finalize,
+};
+
+
+/* --------------------------------------------------------------------------
+   Pool
+   -------------------------------------------------------------------------- */
+
+/* one writer and size readers on the same file, idle readers are kept on a
+   stack (most recently used first) and handed out under the GIL, a thread
+   only waits (without the GIL) when all readers are checked out */
+
+#define __POOL_SIZE__ 4
+
+
+static Pool *
+__pool_alloc__(PyTypeObject *type)
+{
+    Pool *self = NULL;
+
+    if ((self = PyObject_GC_NEW(Pool, type))) {
+        self->filename = NULL;
+        self->writer = NULL;
+        self->readers = NULL;
+        self->routes = NULL;
+        self->idle = NULL;
+        self->size = 0;
+        self->available = 0;
+        self->lock = NULL;
+        self->waiters = 0;
+        self->signaled = 0;
+        self->checkouts = 0;
+        self->waits = 0;
+        self->wait_time = 0;
+        self->max_wait = 0;
+        self->max_in_use = 0;
+    }
+    return self;
+}
+
+
+/* every reader opening its own (empty) database would be useless */
+static int
+__pool_check_name__(PyObject *name, int flags)
+{
+    PyObject *bytes = NULL;
+    const char *filename = NULL;
+    int res = 0;
+
+    if (!PyUnicode_FSConverter(name, &bytes)) {
+        return -1;
+    }
+    filename = PyBytes_AS_STRING(bytes);
+    if (
+        (flags & SQLITE_OPEN_MEMORY) ||
+        !filename[0] ||
+        !strcmp(filename, ":memory:") ||
+        (!strncmp(filename, "file:", 5) && strstr(filename, "mode=memory"))
+    ) {
+        PyErr_SetString(
+            PyExc_ValueError, "a pool needs a database file, not a memory one"
+        );
+        res = -1;
+    }
+    Py_DECREF(bytes);
+    return res;
+}
+
+
+static int
+__pool_open__(Pool *self, PyObject *name, Py_ssize_t size, int flags)
+{
+    PyObject *reader = NULL;
+    Py_ssize_t i;
+
+    if (size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "readers must be > 0");
+        return -1;
+    }
+    if (__pool_check_name__(name, flags)) {
+        return -1;
+    }
+    if (
+        !(self->filename = Py_NewRef(name)) ||
+        !(self->routes = PyDict_New()) ||
+        !(self->readers = PyList_New(0)) ||
+        !(self->idle = PyMem_Calloc(size, sizeof(Database *))) ||
+        !(self->lock = PyThread_allocate_lock())
+    ) {
+        if (!PyErr_Occurred()) {
+            PyErr_NoMemory();
+        }
+        return -1;
+    }
+    // the lock is used as a binary semaphore, waiters block on it
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    if (
+        !(
+            self->writer = (Database *)PyObject_CallFunction(
+                (PyObject *)&Database_Type,
+                "Oi",
+                name,
+                flags | SQLITE_OPEN_FULLMUTEX
+            )
+        )
+    ) {
+        return -1;
+    }
+    for (i = 0; i < size; ++i) {
+        if (
+            !(
+                reader = PyObject_CallFunction(
+                    (PyObject *)&Database_Type,
+                    "Oi",
+                    name,
+                    SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX
+                )
+            ) ||
+            PyList_Append(self->readers, reader)
+        ) {
+            Py_XDECREF(reader);
+            return -1;
+        }
+        self->idle[self->available++] = (Database *)reader; // borrowed
+        Py_DECREF(reader);
+    }
+    self->size = size;
+    return 0;
+}
+
+
+static void
+__pool_signal__(Pool *self)
+{
+    if (self->waiters && self->available && !self->signaled) {
+        self->signaled = 1;
+        PyThread_release_lock(self->lock);
+    }
+}
+
+
+static Database *
+__pool_acquire__(Pool *self, double timeout)
+{
+    Database *reader = NULL;
+    _PyTime_t start = 0, deadline = 0, now = 0, elapsed = 0;
+    PY_TIMEOUT_T microseconds = -1;
+    PyLockStatus status = PY_LOCK_ACQUIRED;
+
+    if (!self->available) {
+        start = _PyTime_GetPerfCounter();
+        if (timeout >= 0) {
+            deadline = start + (_PyTime_t)(timeout * 1e9);
+        }
+        self->waits++;
+        while (!self->available) {
+            if (timeout >= 0) {
+                if ((now = _PyTime_GetPerfCounter()) >= deadline) {
+                    status = PY_LOCK_FAILURE;
+                    break;
+                }
+                microseconds = (deadline - now) / 1000;
+            }
+            self->waiters++;
+            Py_BEGIN_ALLOW_THREADS
+            status = PyThread_acquire_lock_timed(self->lock, microseconds, 0);
+            Py_END_ALLOW_THREADS
+            self->waiters--;
+            if (status == PY_LOCK_ACQUIRED) {
+                self->signaled = 0;
+            }
+        }
+        elapsed = _PyTime_GetPerfCounter() - start;
+        self->wait_time += elapsed;
+        if (elapsed > self->max_wait) {
+            self->max_wait = elapsed;
+        }
+        if (!self->available) {
+            PyErr_SetString(PyExc_TimeoutError, "no reader available");
+            return NULL;
+        }
+    }
+    reader = self->idle[--self->available];
+    // a reader belongs to the thread that checked it out
+    if (reader->thread) {
+        reader->thread = PyThread_get_thread_ident();
+    }
+    self->checkouts++;
+    if ((self->size - self->available) > self->max_in_use) {
+        self->max_in_use = self->size - self->available;
+    }
+    // wake up the next waiter if there is still a reader left
+    __pool_signal__(self);
+    return (Database *)Py_NewRef(reader);
+}
+
+
+static int
+__pool_release__(Pool *self, PyObject *reader)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < self->available; ++i) {
+        if ((PyObject *)self->idle[i] == reader) {
+            PyErr_SetString(PyExc_ValueError, "reader already released");
+            return -1;
+        }
+    }
+    if (
+        (self->available >= self->size) ||
+        ((i = PySequence_Index(self->readers, reader)) < 0)
+    ) {
+        PyErr_Clear();
+        PyErr_SetString(PyExc_ValueError, "not a reader of this pool");
+        return -1;
+    }
+    self->idle[self->available++] = (Database *)PyList_GET_ITEM(self->readers, i);
+    __pool_signal__(self);
+    return 0;
+}
+
+
+/* a statement goes to a reader if it only reads and returns rows (this keeps
+   BEGIN/COMMIT and friends on the writer) */
+static int
+__pool_route__(Pool *self, PyObject *sql, Database *reader)
+{
+    Stmt *entry = NULL;
+    int res = 0;
+
+    if (!(entry = __stmt_acquire__(reader, sql))) {
+        // the writer may know more (functions, temp tables, ...), let it try
+        if (!PyErr_ExceptionMatches(SQLiteError)) {
+            return -1;
+        }
+        PyErr_Clear();
+        return PyDict_SetItem(self->routes, sql, Py_False) ? -1 : 0;
+    }
+    res = (
+        entry->stmt &&
+        sqlite3_stmt_readonly(entry->stmt) &&
+        __sqlite_column_count__(entry->stmt)
+    );
+    if (
+        __stmt_release__(reader, entry) ||
+        PyDict_SetItem(self->routes, sql, res ? Py_True : Py_False)
+    ) {
+        return -1;
+    }
+    return res;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* execute_range() splits [start, stop) in partitions, each reader (checked
+   out for the whole call) runs on its own thread (the caller's being one of
+   them) and takes the next partition until there is none left, rows are
+   copied into one chunk per partition without the GIL and the result is built
+   once every runner is done, partition after partition or merged on a key */
+
+static void
+__runner_run__(Runner *self)
+{
+    Range *range = self->range;
+    sqlite3_stmt *stmt = self->entry->stmt;
+    sqlite3 *db = self->reader->db;
+    Partition *partition = NULL;
+    const char *errmsg = NULL;
+    Py_ssize_t i;
+    int rc = SQLITE_OK, k;
+
+    // the extra parameters are the same for every partition
+    for (k = 0; (k < range->size) && (rc == SQLITE_OK); ++k) {
+        rc = __stmt_bind_cvalue__(stmt, k + 3, &range->values[k]);
+    }
+    while (
+        !atomic_load(&range->failed) &&
+        ((i = atomic_fetch_add(&range->next, 1)) < range->count)
+    ) {
+        partition = &range->partitions[i];
+        if (
+            (rc == SQLITE_OK) &&
+            ((rc = sqlite3_bind_int64(stmt, 1, partition->start)) == SQLITE_OK) &&
+            ((rc = sqlite3_bind_int64(stmt, 2, partition->stop)) == SQLITE_OK)
+        ) {
+            rc = __chunk_fill__(&partition->chunk, stmt, PY_SSIZE_T_MAX);
+        }
+        if ((partition->rc = rc) != SQLITE_DONE) {
+            if (rc != SQLITE_NOMEM) {
+                partition->errcode = sqlite3_extended_errcode(db);
+                if ((errmsg = sqlite3_errmsg(db))) {
+                    partition->errmsg = __strdup__(errmsg);
+                }
+            }
+            atomic_store(&range->failed, 1);
+        }
+        sqlite3_reset(stmt);
+        rc = SQLITE_OK;
+    }
+    sqlite3_clear_bindings(stmt);
+}
+
+
+static void
+__runner_thread__(void *arg)
+{
+    Runner *self = arg;
+
+    __runner_run__(self);
+    PyThread_release_lock(self->exited);
+}
+
+
+/* sqlite order: NULL < numbers < text < blob (binary collation) */
+static int
+__value_compare__(Chunk *a, Value *x, Chunk *b, Value *y)
+{
+    static const int ranks[] = {
+        [SQLITE_INTEGER] = 1,
+        [SQLITE_FLOAT] = 1,
+        [SQLITE_TEXT] = 2,
+        [SQLITE_BLOB] = 3,
+        [SQLITE_NULL] = 0,
+    };
+    size_t size;
+    int res = ranks[x->type] - ranks[y->type];
+
+    if (res) {
+        return res;
+    }
+    switch (x->type) {
+        case SQLITE_INTEGER:
+        case SQLITE_FLOAT:
+            return __value_number_compare__(x, y);
+        case SQLITE_TEXT:
+        case SQLITE_BLOB:
+            size = Py_MIN(x->size, y->size);
+            if (
+                (
+                    res = memcmp(
+                        a->data + x->value.offset, b->data + y->value.offset, size
+                    )
+                )
+            ) {
+                return res;
+            }
+            return (x->size > y->size) - (x->size < y->size);
+        default:
+            return 0;
+    }
+}
+
+
+static int
+__range_merge__(
+    Range *range,
+    Plan *plan,
+    int format,
+    PyObject *layout,
+    int key,
+    int reverse,
+    PyObject *rows
 )
 {
-    PyObject *row = NULL, *value = NULL;
-    PyTypeObject *_type_ = *rowtype;
-    int i, rc = -1;
+    Partition *partitions = range->partitions, *best = NULL, *partition = NULL;
+    Py_ssize_t *heads = NULL, i, b = 0;
+    PyObject *row = NULL;
+    int res = -1;
 
-    if (!_type_) {
-        _type_ = __new_rowtype__(self, stmt, len);
-        if (!_type_) {
-            goto exit;
-        }
-        else {
-            *rowtype = _type_;
-        }
+    if (!(heads = PyMem_Calloc(range->count, sizeof(Py_ssize_t)))) {
+        PyErr_NoMemory();
+        return -1;
     }
-    if ((row = PyStructSequence_New(_type_))) {
-        for (i = 0; i < len; ++i) {
-            if (!(value = __column_value__(self, stmt, i))) {
-                goto fail;
+    while (1) {
+        for (best = NULL, i = 0; i < range->count; ++i) {
+            partition = &partitions[i];
+            if (
+                (heads[i] < partition->chunk.rows) &&
+                (
+                    !best ||
+                    (
+                        (reverse ? -1 : 1) *
+                        __value_compare__(
+                            &partition->chunk,
+                            &partition->chunk.values[(heads[i] * partition->chunk.cols) + key],
+                            &best->chunk,
+                            &best->chunk.values[(heads[b] * best->chunk.cols) + key]
+                        )
+                    ) < 0
+                )
+            ) {
+                best = partition;
+                b = i;
             }
-            PyStructSequence_SET_ITEM(row, i, value); // steals ref to value
         }
-        rc = PyList_Append(rows, row);
-fail:
-        Py_CLEAR(row);
+        if (!best) {
+            break;
+        }
+        if (
+            !(
+                row = __chunk_row__(
+                    &best->chunk,
+                    plan->decoders,
+                    &best->chunk.values[heads[b]++ * best->chunk.cols],
+                    format,
+                    layout
+                )
+            )
+        ) {
+            goto exit;
+        }
+        res = PyList_Append(rows, row);
+        Py_DECREF(row);
+        if (res) {
+            goto exit;
+        }
     }
+    res = 0;
 exit:
-    return rc;
+    PyMem_Free(heads);
+    return res;
 }
 
 
 static int
-__stmt_bind_value__(
-    Database *self, sqlite3_stmt *stmt, int index, PyObject *value
+__range_rows__(
+    Range *range, Runner *runner, int format, int key, int reverse, PyObject *rows
 )
 {
-    int rc = -1;
+    Partition *partition = NULL;
+    PyObject *layout = NULL;
+    Py_ssize_t i;
 
-    if (value == Py_None) {
-        rc = __sqlite_bind_none__(stmt, index);
-    }
-    else if (value == Py_True) {
-        rc = __sqlite_bind_true__(stmt, index);
-    }
-    else if (value == Py_False) {
-        rc = __sqlite_bind_false__(stmt, index);
-    }
-    else if (PyLong_CheckExact(value)) {
-        long long _value_ = PyLong_AsLongLong(value);
-        if ((_value_ != -1) || !PyErr_Occurred()) {
-            rc = __sqlite_bind_long__(stmt, index, _value_);
+    for (i = 0; (i < range->count) && !partition; ++i) {
+        if (range->partitions[i].chunk.rows) {
+            partition = &range->partitions[i];
         }
     }
-    else if (PyFloat_CheckExact(value)) {
-        rc = __sqlite_bind_float__(stmt, index, PyFloat_AS_DOUBLE(value));
+    if (!partition) {
+        return 0;
     }
-    else if (PyUnicode_CheckExact(value)) {
-        Py_ssize_t _size_;
-        const char *_value_ = PyUnicode_AsUTF8AndSize(value, &_size_);
-        if (_value_) {
-            rc = __sqlite_bind_unicode__(
-                stmt, index, _value_, _size_, SQLITE_STATIC
-            );
-        }
+    if (key >= partition->chunk.cols) {
+        PyErr_SetString(PyExc_IndexError, "key out of range");
+        return -1;
     }
-    else if (PyBytes_CheckExact(value)) {
-        rc = __sqlite_bind_bytes__(
-            stmt,
-            index,
-            PyBytes_AS_STRING(value),
-            PyBytes_GET_SIZE(value),
-            SQLITE_STATIC
-        );
+    // a single value makes no sense across partitions
+    if (format == __ROW_VALUE__) {
+        format = __ROW_SCALAR__;
     }
-    else {
-        PyErr_Format(
-            PyExc_TypeError,
-            "unsupported python type: '%.200s'",
-            Py_TYPE(value)->tp_name
+    if (
+        !(
+            layout = __stmt_layout__(
+                runner->reader,
+                runner->entry,
+                partition->chunk.cols,
+                format,
+                partition->chunk.values
+            )
+        )
+    ) {
+        return -1;
+    }
+    if (key >= 0) {
+        return __range_merge__(
+            range, runner->entry->plan, format, layout, key, reverse, rows
         );
     }
-    if ((rc != SQLITE_OK) && !PyErr_Occurred()) {
-        _PyErr_FromDatabase(self);
+    for (i = 0; i < range->count; ++i) {
+        if (
+            __chunk_rows__(
+                &range->partitions[i].chunk,
+                runner->entry->plan,
+                format,
+                layout,
+                rows
+            )
+        ) {
+            return -1;
+        }
     }
-    return rc;
+    return 0;
 }
 
 
 static int
-__stmt_bind_params__(
-    Database *self, sqlite3_stmt *stmt, int count, PyObject *params
-)
+__range_error__(Range *range, Database *reader)
 {
-    Py_ssize_t size = __params_size__(params);
-    int i;
+    Partition *partition = NULL;
+    Py_ssize_t i;
 
-    for (i = 0; ((i < size) && (i < count)); ++i) {
-        if (__stmt_bind_value__(self, stmt, i + 1, __params_item__(params, i))) {
+    for (i = 0; i < range->count; ++i) {
+        partition = &range->partitions[i];
+        if ((partition->rc != SQLITE_OK) && (partition->rc != SQLITE_DONE)) {
+            if (partition->rc == SQLITE_NOMEM) {
+                PyErr_NoMemory();
+            }
+            else {
+                _PyErr_FromDatabaseError(
+                    reader,
+                    partition->errcode,
+                    (partition->errmsg) ?
+                    partition->errmsg : sqlite3_errstr(partition->rc)
+                );
+            }
             return -1;
         }
     }
@@ -481,136 +9069,232 @@ __stmt_bind_params__(
 
 
 static int
-__db_execute__(
-    Database *self,
-    const char *sql,
-    const char **tail,
+__runner_init__(Runner *self, Range *range, Database *reader, PyObject *sql)
+{
+    self->range = range;
+    self->reader = reader;
+    if (!(self->entry = __stmt_acquire__(reader, sql))) {
+        return -1;
+    }
+    if (!self->entry->stmt || !sqlite3_stmt_readonly(self->entry->stmt)) {
+        PyErr_SetString(
+            PyExc_ValueError, "execute_range() only runs read-only queries"
+        );
+        return -1;
+    }
+    if (__sqlite_bind_count__(self->entry->stmt) < 2) {
+        PyErr_SetString(
+            PyExc_ValueError,
+            "the query must have (at least) 2 parameters (start and stop)"
+        );
+        return -1;
+    }
+    return 0;
+}
+
+
+static PyObject *
+__pool_range__(
+    Pool *self,
+    PyObject *sql,
+    long long start,
+    long long stop,
+    Py_ssize_t count,
     PyObject *params,
-    PyObject **result
+    int format,
+    int key,
+    int reverse
 )
 {
-    sqlite3_stmt *stmt = NULL;
+    Range range = { .partitions = NULL, .values = NULL, .size = 0 };
+    Runner *runners = NULL;
+    Database *reader = NULL;
     PyObject *rows = NULL;
-    PyTypeObject *rowtype = NULL;
-    int count = 0, len = 0;
+    unsigned long long width = 0, step = 0, rem = 0, offset = 0;
+    Py_ssize_t size = 0, i;
+    int res = -1, k;
 
-    if (__sqlite_stmt_prepare__(self->db, sql, strlen(sql) + 1, &stmt, tail)) {
-        _PyErr_FromDatabase(self);
-        return -1;
+    if (!(rows = PyList_New(0)) || (stop <= start)) {
+        return rows;
+    }
+    width = (unsigned long long)stop - (unsigned long long)start;
+    if (count <= 0) {
+        count = self->size;
+    }
+    if ((unsigned long long)count > width) {
+        count = (Py_ssize_t)width;
+    }
+    atomic_init(&range.next, 0);
+    atomic_init(&range.failed, 0);
+    if (
+        !(range.partitions = PyMem_Calloc(count, sizeof(Partition))) ||
+        !(runners = PyMem_Calloc(Py_MIN(count, self->size), sizeof(Runner)))
+    ) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    range.count = count;
+    step = width / count;
+    rem = width % count;
+    for (i = 0; i < count; ++i) {
+        range.partitions[i].start = (long long)((unsigned long long)start + offset);
+        offset += step + ((unsigned long long)i < rem);
+        range.partitions[i].stop = (long long)((unsigned long long)start + offset);
+        __chunk_init__(&range.partitions[i].chunk);
     }
-    if (stmt) {
+    // wait for one reader, take whatever else is available
+    do {
+        if (!(reader = __pool_acquire__(self, -1.0))) {
+            goto exit;
+        }
+        if (__runner_init__(&runners[size++], &range, reader, sql)) {
+            goto exit;
+        }
+    } while ((size < Py_MIN(count, self->size)) && self->available);
+    if (params) {
+        range.size = (int)Py_MIN(
+            __params_size__(params),
+            __sqlite_bind_count__(runners[0].entry->stmt) - 2
+        );
+        if (!(range.values = PyMem_Calloc(Py_MAX(range.size, 1), sizeof(Value)))) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+        for (k = 0; k < range.size; ++k) {
+            if (__value_from_object__(&range.values[k], __params_item__(params, k))) {
+                goto exit;
+            }
+        }
+    }
+    for (i = 1; i < size; ++i) {
+        if (!(runners[i].exited = PyThread_allocate_lock())) {
+            continue; // the other runners will take its share
+        }
+        PyThread_acquire_lock(runners[i].exited, WAIT_LOCK);
         if (
-            !params ||
-            !(count = __sqlite_bind_count__(stmt)) ||
-            !__stmt_bind_params__(self, stmt, count, params)
+            PyThread_start_new_thread(__runner_thread__, &runners[i]) ==
+            PYTHREAD_INVALID_THREAD_ID
         ) {
-            if ((rows = PyList_New(0))) {
-                len = __sqlite_column_count__(stmt);
-                while (__sqlite_stmt_step__(stmt) == SQLITE_ROW) {
-                    if (__stmt_row__(self, stmt, len, rows, &rowtype)) {
-                        break;
-                    }
-                }
-                if (!__db_err_occurred__(self) && !PyErr_Occurred()) {
-                    *result = Py_NewRef(PyList_GET_SIZE(rows) ? rows : Py_None);
-                }
-                Py_CLEAR(rowtype);
-                Py_CLEAR(rows);
-            }
+            PyThread_free_lock(runners[i].exited);
+            runners[i].exited = NULL;
         }
-        if (__sqlite_stmt_finalize__(stmt)) {
-            _PyErr_FromDatabase(self);
+    }
+    Py_BEGIN_ALLOW_THREADS
+    __runner_run__(&runners[0]);
+    for (i = 1; i < size; ++i) {
+        if (runners[i].exited) {
+            PyThread_acquire_lock(runners[i].exited, WAIT_LOCK);
         }
-        if (PyErr_Occurred()) {
-            return -1;
+    }
+    Py_END_ALLOW_THREADS
+    if (
+        !__range_error__(&range, runners[0].reader) &&
+        !__range_rows__(&range, &runners[0], format, key, reverse, rows)
+    ) {
+        res = 0;
+    }
+exit:
+    if (runners) {
+        for (i = 0; i < size; ++i) {
+            if (runners[i].exited) {
+                PyThread_free_lock(runners[i].exited);
+            }
+            if (runners[i].entry && __stmt_release__(runners[i].reader, runners[i].entry)) {
+                res = -1;
+            }
+            if (__pool_release__(self, (PyObject *)runners[i].reader)) {
+                res = -1;
+            }
+            Py_DECREF(runners[i].reader);
         }
+        PyMem_Free(runners);
     }
-    return 0;
+    if (range.partitions) {
+        for (i = 0; i < count; ++i) {
+            __chunk_free__(&range.partitions[i].chunk);
+            free(range.partitions[i].errmsg);
+        }
+        PyMem_Free(range.partitions);
+    }
+    PyMem_Free(range.values);
+    if (res) {
+        Py_CLEAR(rows);
+    }
+    return rows;
 }
 
 
 /* -------------------------------------------------------------------------- */
 
-/* Database_Type.tp_finalize */
-static void
-Database_tp_finalize(Database *self)
-{
-    PyObject *_exc_type_ = NULL, *_exc_value_ = NULL, *_exc_traceback_ = NULL;
-
-    PyErr_Fetch(&_exc_type_, &_exc_value_, &_exc_traceback_);
-    if (__db_close__(self)) {
-        PyErr_WriteUnraisable((PyObject *)self);
-    }
-    PyErr_Restore(_exc_type_, _exc_value_, _exc_traceback_);
-}
-
-
-/* Database_Type.tp_traverse */
+/* Pool_Type.tp_traverse */
 static int
-Database_tp_traverse(Database *self, visitproc visit, void *arg)
+Pool_tp_traverse(Pool *self, visitproc visit, void *arg)
 {
     Py_VISIT(self->filename);
+    Py_VISIT(self->writer);
+    Py_VISIT(self->readers);
+    Py_VISIT(self->routes);
     return 0;
 }
 
 
-/* Database_Type.tp_clear */
+/* Pool_Type.tp_clear */
 static int
-Database_tp_clear(Database *self)
+Pool_tp_clear(Pool *self)
 {
+    self->available = 0;
+    Py_CLEAR(self->routes);
+    Py_CLEAR(self->readers);
+    Py_CLEAR(self->writer);
     Py_CLEAR(self->filename);
     return 0;
 }
 
 
-/* Database_Type.tp_dealloc */
+/* Pool_Type.tp_dealloc */
 static void
-Database_tp_dealloc(Database *self)
+Pool_tp_dealloc(Pool *self)
 {
-    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
-        return;
-    }
     PyObject_GC_UnTrack(self);
-    Database_tp_clear(self);
+    Pool_tp_clear(self);
+    PyMem_Free(self->idle);
+    if (self->lock) {
+        PyThread_free_lock(self->lock);
+    }
     PyObject_GC_Del(self);
 }
 
 
-/* Database_Type.tp_repr */
+/* Pool_Type.tp_repr */
 static PyObject *
-Database_tp_repr(Database *self)
+Pool_tp_repr(Pool *self)
 {
-    PyObject *_filename_ = NULL, *result = NULL;
-
-    if ((_filename_ = _PyUnicode_DecodeFSDefault(self->filename))) {
-        result = PyUnicode_FromFormat(
-            "<%s(%R)>", Py_TYPE(self)->tp_name, _filename_
-        );
-        Py_DECREF(_filename_);
-    }
-    return result;
+    return PyUnicode_FromFormat(
+        "<%s(%R, readers=%zd)>", Py_TYPE(self)->tp_name, self->filename, self->size
+    );
 }
 
 
-/* Database_Type.tp_new */
+/* Pool_Type.tp_new */
 static PyObject *
-Database_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+Pool_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
 {
-    int flags = SQLITE_OPEN_READONLY;
-    Database *self = NULL;
+    static char *kwlist[] = {"name", "readers", "flags", NULL};
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    Py_ssize_t size = __POOL_SIZE__;
+    PyObject *name = NULL;
+    Pool *self = NULL;
 
-    if ((self = __db_alloc__(type))) {
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O|n$i:__new__", kwlist, &name, &size, &flags
+        )
+    ) {
+        return NULL;
+    }
+    if ((self = __pool_alloc__(type))) {
         PyObject_GC_Track(self);
-        if (
-            !PyArg_ParseTuple(
-                args,
-                "O&|i:__new__",
-                PyUnicode_FSConverter,
-                &self->filename,
-                &flags
-            ) ||
-            __db_open__(self, flags | SQLITE_OPEN_URI | SQLITE_OPEN_EXRESCODE)
-        ) {
+        if (__pool_open__(self, name, size, flags)) {
             Py_CLEAR(self);
         }
     }
@@ -620,109 +9304,190 @@ Database_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
 
 /* -------------------------------------------------------------------------- */
 
-/* Database.execute() */
+/* Pool.acquire() */
 static PyObject *
-Database_execute(Database *self, PyObject *args)
+Pool_acquire(Pool *self, PyObject *args)
 {
-    PyObject *result = NULL, *params = NULL, *_params_ = NULL;
-    const char *sql = NULL;
-    Py_ssize_t size = 0, i = 0;
+    double timeout = -1.0;
+
+    if (!PyArg_ParseTuple(args, "|d:acquire", &timeout)) {
+        return NULL;
+    }
+    return (PyObject *)__pool_acquire__(self, timeout);
+}
+
+
+/* Pool.release() */
+static PyObject *
+Pool_release(Pool *self, PyObject *reader)
+{
+    if (__pool_release__(self, reader)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Pool.execute() */
+static PyObject *
+Pool_execute(Pool *self, PyObject *args, PyObject *kwargs)
+{
+    PyObject *sql = NULL, *route = NULL, *result = NULL;
+    Database *reader = NULL;
+    int res = 0;
 
+    if (!PyArg_ParseTuple(args, "U|O:execute", &sql, &route)) {
+        return NULL;
+    }
     if (
-        !PyArg_ParseTuple(
-            args, "s|O&:execute", &sql, __params_converter__, &params
-        )
+        !(route = PyDict_GetItemWithError(self->routes, sql)) &&
+        PyErr_Occurred()
     ) {
         return NULL;
     }
-    size = (params) ? __params_size__(params) : 0;
-    do {
-        Py_CLEAR(result);
-        if (
-            (
-                (_params_ = (size) ? __params_item__(params, i) : NULL) &&
-                !__params_check__(_params_)
-            ) ||
-            __db_execute__(self, sql, NULL, _params_, &result)
-        ) {
+    if (route != Py_False) {
+        if (!(reader = __pool_acquire__(self, -1.0))) {
             return NULL;
         }
-        ++i;
-    } while (i < size);
-    return (result) ? result : Py_NewRef(Py_None);
+        res = (route) ? 1 : __pool_route__(self, sql, reader);
+        if (res > 0) {
+            result = Database_execute(reader, args, kwargs);
+        }
+        if (__pool_release__(self, (PyObject *)reader)) {
+            Py_CLEAR(result);
+            res = -1;
+        }
+        Py_DECREF(reader);
+        if (res) {
+            return result;
+        }
+    }
+    return Database_execute(self->writer, args, kwargs);
 }
 
 
-/* Database.executescript() */
+/* Pool.execute_range() */
 static PyObject *
-Database_executescript(Database *self, PyObject *args)
+Pool_execute_range(Pool *self, PyObject *args, PyObject *kwargs)
 {
-    PyObject *results = NULL, *result = NULL;
-    const char *sql = NULL, *tail = NULL;
+    static char *kwlist[] = {
+        "sql",
+        "start",
+        "stop",
+        "partitions",
+        "params",
+        "key",
+        "reverse",
+        "row_format",
+        NULL
+    };
+    PyObject *sql = NULL, *params = NULL;
+    long long start = 0, stop = 0;
+    Py_ssize_t count = 0;
+    int key = -1, reverse = 0, format = self->writer->format;
 
     if (
-        !PyArg_ParseTuple(args, "s:execute", &sql) ||
-        !(results = PyList_New(0))
+        !PyArg_ParseTupleAndKeywords(
+            args,
+            kwargs,
+            "ULL|$nO&ipO&:execute_range",
+            kwlist,
+            &sql,
+            &start,
+            &stop,
+            &count,
+            __params_converter__,
+            &params,
+            &key,
+            &reverse,
+            __row_format_converter__,
+            &format
+        )
     ) {
         return NULL;
     }
-    while (sql[0]) {
-        if (
-            __db_execute__(self, sql, &tail, NULL, &result) ||
-            (result && PyList_Append(results, result))
-        ) {
-            Py_CLEAR(result);
-            Py_CLEAR(results);
-            break;
-        }
-        Py_CLEAR(result);
-        sql = tail;
+    if (key < -1) {
+        PyErr_SetString(PyExc_ValueError, "key must be >= -1");
+        return NULL;
     }
-    return results;
+    return __pool_range__(
+        self, sql, start, stop, count, params, format, key, reverse
+    );
 }
 
 
-/* Database_Type.tp_methods */
-static PyMethodDef Database_tp_methods[] = {
-    {"execute", (PyCFunction)Database_execute, METH_VARARGS, NULL},
-    {"executescript", (PyCFunction)Database_executescript, METH_VARARGS, NULL},
+/* Pool_Type.tp_methods */
+static PyMethodDef Pool_tp_methods[] = {
+    {"acquire", (PyCFunction)Pool_acquire, METH_VARARGS, NULL},
+    {"release", (PyCFunction)Pool_release, METH_O, NULL},
+    {
+        "execute",
+        (PyCFunction)Pool_execute,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {
+        "execute_range",
+        (PyCFunction)Pool_execute_range,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
     {NULL}
 };
 
 
 /* -------------------------------------------------------------------------- */
 
-/* Database.readonly */
+/* Pool.writer */
 static PyObject *
-Database_readonly_getter(Database *self, void *closure)
+Pool_writer_getter(Pool *self, void *closure)
 {
-    return PyBool_FromLong(__sqlite_db_readonly__(self->db, NULL));
+    return Py_NewRef(self->writer);
 }
 
 
-/* Database_Type.tp_getsets */
-static PyGetSetDef Database_tp_getset[] = {
-    {"readonly", (getter)Database_readonly_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+/* Pool.stats */
+static PyObject *
+Pool_stats_getter(Pool *self, void *closure)
+{
+    return Py_BuildValue(
+        "{s:n,s:n,s:n,s:i,s:K,s:K,s:d,s:d,s:d}",
+        "readers", self->size,
+        "in_use", self->size - self->available,
+        "max_in_use", self->max_in_use,
+        "waiting", self->waiters,
+        "checkouts", self->checkouts,
+        "waits", self->waits,
+        "wait_time", _PyTime_AsSecondsDouble(self->wait_time),
+        "max_wait", _PyTime_AsSecondsDouble(self->max_wait),
+        "utilization", (self->size) ? ((double)(self->size - self->available) / self->size) : 0.0
+    );
+}
+
+
+/* Pool_Type.tp_getsets */
+static PyGetSetDef Pool_tp_getset[] = {
+    {"writer", (getter)Pool_writer_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
+    {"stats", (getter)Pool_stats_getter, _Py_READONLY_ATTRIBUTE, NULL, NULL},
     {NULL}
 };
 
 
-/* Database_Type ------------------------------------------------------------ */
+/* Pool_Type ---------------------------------------------------------------- */
 
-static PyTypeObject Database_Type = {
+static PyTypeObject Pool_Type = {
     PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "mood.sqlite.Database",
-    .tp_basicsize = sizeof(Database),
-    .tp_dealloc = (destructor)Database_tp_dealloc,
-    .tp_repr = (reprfunc)Database_tp_repr,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
-    .tp_doc = "Database(name[, flags])",
-    .tp_traverse = (traverseproc)Database_tp_traverse,
-    .tp_clear = (inquiry)Database_tp_clear,
-    .tp_methods = Database_tp_methods,
-    .tp_getset = Database_tp_getset,
-    .tp_new = (newfunc)Database_tp_new,
-    .tp_finalize = (destructor)Database_tp_finalize,
+    .tp_name = "mood.sqlite.Pool",
+    .tp_basicsize = sizeof(Pool),
+    .tp_dealloc = (destructor)Pool_tp_dealloc,
+    .tp_repr = (reprfunc)Pool_tp_repr,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_doc = "Pool(name[, readers=4, *, flags=SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE])",
+    .tp_traverse = (traverseproc)Pool_tp_traverse,
+    .tp_clear = (inquiry)Pool_tp_clear,
+    .tp_methods = Pool_tp_methods,
+    .tp_getset = Pool_tp_getset,
+    .tp_new = (newfunc)Pool_tp_new,
 };
 
 
@@ -730,11 +9495,49 @@ static PyTypeObject Database_Type = {
     module
    -------------------------------------------------------------------------- */
 
+/* sqlite.status() */
+static PyObject *
+sqlite_status(PyObject *module, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"reset", NULL};
+    int reset = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p:status", kwlist, &reset)) {
+        return NULL;
+    }
+    return __status__(NULL, __status_fields__, reset);
+}
+
+
+/* sqlite.clear_shared() */
+static PyObject *
+sqlite_clear_shared(PyObject *module)
+{
+    __parked_clear__();
+    Py_RETURN_NONE;
+}
+
+
+/* sqlite_def.m_methods */
+static PyMethodDef sqlite_m_methods[] = {
+    {
+        "status",
+        (PyCFunction)sqlite_status,
+        METH_VARARGS | METH_KEYWORDS,
+        NULL
+    },
+    {"clear_shared", (PyCFunction)sqlite_clear_shared, METH_NOARGS, NULL},
+    {NULL}
+};
+
+
 /* sqlite_def.m_traverse */
 static int
 sqlite_m_traverse(PyObject *module, visitproc visit, void *arg)
 {
     Py_VISIT(SQLiteError);
+    Py_VISIT(ProgrammingError);
+    Py_VISIT(GetRunningLoop);
     return 0;
 }
 
@@ -743,6 +9546,9 @@ sqlite_m_traverse(PyObject *module, visitproc visit, void *arg)
 static int
 sqlite_m_clear(PyObject *module)
 {
+    __parked_clear__();
+    Py_CLEAR(GetRunningLoop);
+    Py_CLEAR(ProgrammingError);
     Py_CLEAR(SQLiteError);
     return 0;
 }
@@ -762,6 +9568,7 @@ static PyModuleDef sqlite_def = {
     .m_name = "sqlite",
     .m_doc = "mood sqlite module",
     .m_size = -1,
+    .m_methods = sqlite_m_methods,
     .m_traverse = (traverseproc)sqlite_m_traverse,
     .m_clear = (inquiry)sqlite_m_clear,
     .m_free = (freefunc)sqlite_m_free,
@@ -776,8 +9583,23 @@ __module_init__(PyObject *module)
         _PyModule_AddNewException(
             module, "SQLiteError", "mood.sqlite", NULL, NULL, &SQLiteError
         ) ||
+        _PyModule_AddNewException(
+            module,
+            "ProgrammingError",
+            "mood.sqlite",
+            SQLiteError,
+            NULL,
+            &ProgrammingError
+        ) ||
         _PyType_ReadyWithBase(&RowType_Type, &PyType_Type) ||
         PyModule_AddType(module, &Database_Type) ||
+        PyModule_AddType(module, &Cursor_Type) ||
+        PyModule_AddType(module, &Statement_Type) ||
+        PyModule_AddType(module, &Buffer_Type) ||
+        PyModule_AddType(module, &Column_Type) ||
+        PyModule_AddType(module, &Transaction_Type) ||
+        PyModule_AddType(module, &Blob_Type) ||
+        PyModule_AddType(module, &Pool_Type) ||
         _PyModule_AddIntMacro(module, SQLITE_OPEN_READONLY) ||
         _PyModule_AddIntMacro(module, SQLITE_OPEN_READWRITE) ||
         _PyModule_AddIntMacro(module, SQLITE_OPEN_CREATE) ||
@@ -787,8 +9609,19 @@ __module_init__(PyObject *module)
         _PyModule_AddIntMacro(module, SQLITE_OPEN_SHAREDCACHE) ||
         _PyModule_AddIntMacro(module, SQLITE_OPEN_PRIVATECACHE) ||
         _PyModule_AddIntMacro(module, SQLITE_OPEN_NOFOLLOW) ||
+        _PyModule_AddIntMacro(module, SQLITE_INTEGER) ||
+        _PyModule_AddIntMacro(module, SQLITE_FLOAT) ||
+        _PyModule_AddIntMacro(module, SQLITE_TEXT) ||
+        _PyModule_AddIntMacro(module, SQLITE_BLOB) ||
+        _PyModule_AddIntMacro(module, SQLITE_NULL) ||
+        PyModule_AddIntConstant(module, "ROW_STRUCT", __ROW_STRUCT__) ||
+        PyModule_AddIntConstant(module, "ROW_TUPLE", __ROW_TUPLE__) ||
+        PyModule_AddIntConstant(module, "ROW_DICT", __ROW_DICT__) ||
+        PyModule_AddIntConstant(module, "ROW_SCALAR", __ROW_SCALAR__) ||
+        PyModule_AddIntConstant(module, "ROW_VALUE", __ROW_VALUE__) ||
         PyModule_AddStringConstant(module, "__version__", PKG_VERSION)
     ) {
+        Py_CLEAR(ProgrammingError);
         Py_CLEAR(SQLiteError);
         return -1;
     }